@@ -0,0 +1,158 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+
+// Checks that each blend kernel the CPU supports (SSE2, AVX2) gives the same pixels as the
+// scalar code, on a footer sized buffer at 4K width (and on short rows, to cover the tails).
+// Then times each kernel on the footer.
+
+#include "egblend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+int const width = 3840;
+int const height = 48;
+
+struct Buffer
+{
+    std::vector<unsigned char> alpha;   // Coverage: width x height
+    std::vector<unsigned char> pixels;  // ARGB8888: width x height
+};
+
+// Coverage as glyphs give it: mostly empty or solid with some edges
+auto make_buffer() -> Buffer
+{
+    std::mt19937 random{42};
+    std::uniform_int_distribution<int> byte{0, 0xff};
+
+    Buffer result{std::vector<unsigned char>(width*height), std::vector<unsigned char>(4*width*height)};
+
+    for (auto& a : result.alpha)
+    {
+        switch (auto const r = byte(random); r % 4)
+        {
+        case 0: a = 0; break;
+        case 1: a = 0xff; break;
+        default: a = r;
+        }
+    }
+
+    for (auto& p : result.pixels)
+        p = byte(random);
+
+    return result;
+}
+
+// Blends the rows of the buffer (each as one call, or as calls of row_length pixels)
+template<typename Blend>
+void blend_rows(Buffer& buffer, int row_length, Blend const& blend)
+{
+    for (auto y = 0; y != height; ++y)
+    {
+        for (auto x = 0; x < width; x += row_length)
+        {
+            auto const pixels = std::min(row_length, width - x);
+            blend(buffer.pixels.data() + 4*(y*width + x), buffer.alpha.data() + y*width + x, pixels);
+        }
+    }
+}
+
+auto check(egmde::BlendKernel const& scalar, egmde::BlendKernel const& kernel, Buffer const& original) -> bool
+{
+    auto ok = true;
+
+    // Full rows, and short rows of every length up to two AVX2 vectors
+    for (auto row_length : {width, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17})
+    {
+        for (auto shift : {0U, 1U, 2U, 7U})
+        {
+            auto expected = original;
+            auto actual = original;
+            blend_rows(expected, row_length, [&](auto* d, auto* a, int n) { scalar.blend_or(d, a, n, shift); });
+            blend_rows(actual, row_length, [&](auto* d, auto* a, int n) { kernel.blend_or(d, a, n, shift); });
+
+            if (actual.pixels != expected.pixels)
+            {
+                printf("%s blend_or differs from scalar (row length %d, shift %u)\n", kernel.name, row_length, shift);
+                ok = false;
+            }
+        }
+
+        for (auto opacity : {0x00, 0x01, 0x80, 0xc0, 0xfe, 0xff})
+        {
+            auto expected = original;
+            auto actual = original;
+            blend_rows(expected, row_length, [&](auto* d, auto* a, int n) { scalar.blend_over(d, a, n, opacity); });
+            blend_rows(actual, row_length, [&](auto* d, auto* a, int n) { kernel.blend_over(d, a, n, opacity); });
+
+            if (actual.pixels != expected.pixels)
+            {
+                printf("%s blend_over differs from scalar (row length %d, opacity %#x)\n", kernel.name, row_length, opacity);
+                ok = false;
+            }
+        }
+    }
+
+    return ok;
+}
+
+// The fastest of several runs over the whole buffer, in microseconds
+template<typename Blend>
+auto best_time(Buffer buffer, Blend const& blend) -> double
+{
+    using namespace std::chrono;
+    auto best = duration<double, std::micro>::max();
+
+    for (auto run = 0; run != 20; ++run)
+    {
+        auto const start = steady_clock::now();
+        blend_rows(buffer, width, blend);
+        best = std::min<duration<double, std::micro>>(best, steady_clock::now() - start);
+    }
+
+    return best.count();
+}
+}
+
+int main()
+{
+    auto const kernels = egmde::blend_kernels();
+    auto const& scalar = kernels.front();
+    auto const buffer = make_buffer();
+
+    auto ok = true;
+    for (auto const& kernel : kernels)
+        ok = check(scalar, kernel, buffer) && ok;
+
+    printf("%dx%d footer, best time per frame:\n", width, height);
+    for (auto const& kernel : kernels)
+    {
+        auto const or_time = best_time(buffer, [&](auto* d, auto* a, int n) { kernel.blend_or(d, a, n, 1); });
+        auto const over_time = best_time(buffer, [&](auto* d, auto* a, int n) { kernel.blend_over(d, a, n, 0xc0); });
+        printf("  %-6s  blend_or %8.1fus, blend_over %8.1fus\n", kernel.name, or_time, over_time);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
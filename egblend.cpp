@@ -0,0 +1,262 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "egblend.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EGMDE_BLEND_X86
+#endif
+
+namespace
+{
+// x/255 for x <= 0xff*0xff, without a division
+inline auto div255(unsigned x) -> unsigned
+{
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+void or_scalar(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned shift)
+{
+    for (auto i = 0; i != pixels; ++i)
+    {
+        unsigned char const a = alpha[i] >> shift;
+        for (auto c = 0; c != 4; ++c)
+            dest[4*i + c] |= a;
+    }
+}
+
+void over_scalar(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned char opacity)
+{
+    for (auto i = 0; i != pixels; ++i)
+    {
+        auto const a = div255(opacity*alpha[i]);
+        for (auto c = 0; c != 4; ++c)
+            dest[4*i + c] = a + div255(dest[4*i + c]*(0xff - a));
+    }
+}
+
+#ifdef EGMDE_BLEND_X86
+// The last few pixels of a row, padded to a whole vector (and written back when done). Mixing in
+// the scalar or SSE2 code instead would cost an AVX/SSE transition on each (short) glyph row.
+template<int width>
+struct Tail
+{
+    Tail(unsigned char* row_dest, unsigned char const* row_alpha, int pixels) :
+        row_dest{row_dest}, pixels{pixels}
+    {
+        memcpy(alpha, row_alpha, pixels);
+        memcpy(dest, row_dest, 4*pixels);
+    }
+
+    ~Tail() { memcpy(row_dest, dest, 4*pixels); }
+
+    unsigned char* const row_dest;
+    int const pixels;
+    unsigned char alpha[width] = {};
+    unsigned char dest[4*width] = {};
+};
+
+// Four coverage values, each repeated for the four channels of a pixel
+__attribute__((target("sse2")))
+inline auto expand4(unsigned char const* alpha) -> __m128i
+{
+    int32_t packed;
+    memcpy(&packed, alpha, sizeof packed);
+    auto const a = _mm_cvtsi32_si128(packed);
+    auto const a2 = _mm_unpacklo_epi8(a, a);
+    return _mm_unpacklo_epi16(a2, a2);
+}
+
+__attribute__((target("sse2")))
+inline auto div255_epi16(__m128i x) -> __m128i
+{
+    auto const one = _mm_set1_epi16(1);
+    return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, one), _mm_srli_epi16(x, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+inline auto over_epi16(__m128i dest, __m128i alpha, __m128i opacity) -> __m128i
+{
+    auto const a = div255_epi16(_mm_mullo_epi16(alpha, opacity));
+    auto const inverse = _mm_sub_epi16(_mm_set1_epi16(0xff), a);
+    return _mm_add_epi16(a, div255_epi16(_mm_mullo_epi16(dest, inverse)));
+}
+
+__attribute__((target("sse2")))
+inline void or4(unsigned char* dest, unsigned char const* alpha, __m128i count, __m128i mask)
+{
+    auto const a = _mm_and_si128(_mm_srl_epi16(expand4(alpha), count), mask);
+    auto* const d = reinterpret_cast<__m128i*>(dest);
+    _mm_storeu_si128(d, _mm_or_si128(_mm_loadu_si128(d), a));
+}
+
+__attribute__((target("sse2")))
+inline void over4(unsigned char* dest, unsigned char const* alpha, __m128i opacity)
+{
+    auto const zero = _mm_setzero_si128();
+    auto const a = expand4(alpha);
+    auto* const d = reinterpret_cast<__m128i*>(dest);
+    auto const pixel = _mm_loadu_si128(d);
+
+    auto const lo = over_epi16(_mm_unpacklo_epi8(pixel, zero), _mm_unpacklo_epi8(a, zero), opacity);
+    auto const hi = over_epi16(_mm_unpackhi_epi8(pixel, zero), _mm_unpackhi_epi8(a, zero), opacity);
+    _mm_storeu_si128(d, _mm_packus_epi16(lo, hi));
+}
+
+__attribute__((target("sse2")))
+void or_sse2(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned shift)
+{
+    auto const count = _mm_cvtsi32_si128(shift);
+    auto const mask = _mm_set1_epi8(static_cast<char>(0xff >> shift));
+
+    auto i = 0;
+    for (; i + 4 <= pixels; i += 4)
+        or4(dest + 4*i, alpha + i, count, mask);
+
+    if (auto const rest = pixels - i)
+    {
+        Tail<4> tail{dest + 4*i, alpha + i, rest};
+        or4(tail.dest, tail.alpha, count, mask);
+    }
+}
+
+__attribute__((target("sse2")))
+void over_sse2(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned char opacity)
+{
+    auto const scale = _mm_set1_epi16(opacity);
+
+    auto i = 0;
+    for (; i + 4 <= pixels; i += 4)
+        over4(dest + 4*i, alpha + i, scale);
+
+    if (auto const rest = pixels - i)
+    {
+        Tail<4> tail{dest + 4*i, alpha + i, rest};
+        over4(tail.dest, tail.alpha, scale);
+    }
+}
+
+// Eight coverage values, each repeated for the four channels of a pixel
+__attribute__((target("avx2")))
+inline auto expand8(unsigned char const* alpha) -> __m256i
+{
+    auto const a = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(alpha)));
+    return _mm256_mullo_epi32(a, _mm256_set1_epi32(0x01010101));
+}
+
+__attribute__((target("avx2")))
+inline auto div255_epi16(__m256i x) -> __m256i
+{
+    auto const one = _mm256_set1_epi16(1);
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x, one), _mm256_srli_epi16(x, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+inline auto over_epi16(__m256i dest, __m256i alpha, __m256i opacity) -> __m256i
+{
+    auto const a = div255_epi16(_mm256_mullo_epi16(alpha, opacity));
+    auto const inverse = _mm256_sub_epi16(_mm256_set1_epi16(0xff), a);
+    return _mm256_add_epi16(a, div255_epi16(_mm256_mullo_epi16(dest, inverse)));
+}
+
+__attribute__((target("avx2")))
+inline void or8(unsigned char* dest, unsigned char const* alpha, __m128i count, __m256i mask)
+{
+    auto const a = _mm256_and_si256(_mm256_srl_epi16(expand8(alpha), count), mask);
+    auto* const d = reinterpret_cast<__m256i*>(dest);
+    _mm256_storeu_si256(d, _mm256_or_si256(_mm256_loadu_si256(d), a));
+}
+
+__attribute__((target("avx2")))
+inline void over8(unsigned char* dest, unsigned char const* alpha, __m256i opacity)
+{
+    auto const zero = _mm256_setzero_si256();
+    auto const a = expand8(alpha);
+    auto* const d = reinterpret_cast<__m256i*>(dest);
+    auto const pixel = _mm256_loadu_si256(d);
+
+    // The unpacks and the pack work within each 128-bit lane, so the order is preserved
+    auto const lo = over_epi16(_mm256_unpacklo_epi8(pixel, zero), _mm256_unpacklo_epi8(a, zero), opacity);
+    auto const hi = over_epi16(_mm256_unpackhi_epi8(pixel, zero), _mm256_unpackhi_epi8(a, zero), opacity);
+    _mm256_storeu_si256(d, _mm256_packus_epi16(lo, hi));
+}
+
+__attribute__((target("avx2")))
+void or_avx2(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned shift)
+{
+    auto const count = _mm_cvtsi32_si128(shift);
+    auto const mask = _mm256_set1_epi8(static_cast<char>(0xff >> shift));
+
+    auto i = 0;
+    for (; i + 8 <= pixels; i += 8)
+        or8(dest + 4*i, alpha + i, count, mask);
+
+    if (auto const rest = pixels - i)
+    {
+        Tail<8> tail{dest + 4*i, alpha + i, rest};
+        or8(tail.dest, tail.alpha, count, mask);
+    }
+}
+
+__attribute__((target("avx2")))
+void over_avx2(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned char opacity)
+{
+    auto const scale = _mm256_set1_epi16(opacity);
+
+    auto i = 0;
+    for (; i + 8 <= pixels; i += 8)
+        over8(dest + 4*i, alpha + i, scale);
+
+    if (auto const rest = pixels - i)
+    {
+        Tail<8> tail{dest + 4*i, alpha + i, rest};
+        over8(tail.dest, tail.alpha, scale);
+    }
+}
+#endif
+}
+
+auto egmde::blend_kernels() -> std::vector<BlendKernel>
+{
+    std::vector<BlendKernel> result{{"scalar", or_scalar, over_scalar}};
+
+#ifdef EGMDE_BLEND_X86
+    if (__builtin_cpu_supports("sse2"))
+        result.push_back({"SSE2", or_sse2, over_sse2});
+    if (__builtin_cpu_supports("avx2"))
+        result.push_back({"AVX2", or_avx2, over_avx2});
+#endif
+
+    return result;
+}
+
+void egmde::blend_or(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned shift)
+{
+    static auto const kernel = blend_kernels().back().blend_or;
+    kernel(dest, alpha, pixels, shift);
+}
+
+void egmde::blend_over(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned char opacity)
+{
+    static auto const kernel = blend_kernels().back().blend_over;
+    kernel(dest, alpha, pixels, opacity);
+}
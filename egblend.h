@@ -0,0 +1,46 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGBLEND_H
+#define EGMDE_EGBLEND_H
+
+#include <vector>
+
+namespace egmde
+{
+// Composite a row of 8-bit coverage (white text) onto ARGB8888 pixels, treating all four
+// channels alike. The SSE2/AVX2 versions are picked at runtime and match the scalar code exactly.
+
+// dest |= alpha >> shift
+void blend_or(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned shift);
+
+// dest = a + dest*(0xff - a)/0xff, where a = opacity*alpha/0xff (the divisions round down)
+void blend_over(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned char opacity);
+
+struct BlendKernel
+{
+    char const* name;
+    void (*blend_or)(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned shift);
+    void (*blend_over)(unsigned char* dest, unsigned char const* alpha, int pixels, unsigned char opacity);
+};
+
+// The versions this CPU supports, scalar first and the one blend_or() and blend_over() use last
+auto blend_kernels() -> std::vector<BlendKernel>;
+}
+
+#endif //EGMDE_EGBLEND_H
@@ -0,0 +1,352 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+
+#include "egcatalogue.h"
+#include "egcommandtrie.h"
+#include "egdesktopentry.h"
+#include "egexecutableindex.h"
+#include "eghash.h"
+
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <utility>
+
+namespace
+{
+auto starts_with(std::string_view text, std::string_view prefix) -> bool
+{
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+// Identifies an app in the usage store (never 0)
+auto usage_key(std::string_view desktop_dir, std::string_view desktop_file) -> uint64_t
+{
+    return std::max<uint64_t>(egmde::hash(desktop_file, egmde::hash("/", egmde::hash(desktop_dir))), 1);
+}
+
+// The first 8 bytes of text in big-endian order: comparing these is comparing the start of the
+// text, so most comparisons when sorting don't need to look at the text itself
+auto collation_key(std::string_view text) -> uint64_t
+{
+    uint64_t key = 0;
+    for (size_t i = 0; i != sizeof key; ++i)
+        key = (key << 8) | (i < text.size() ? static_cast<unsigned char>(text[i]) : 0);
+    return key;
+}
+
+auto is_word_char(char c) -> bool
+{
+    return isalnum(static_cast<unsigned char>(c)) || (c & 0x80);
+}
+
+// The number of characters in UTF-8 text (as Printer counts them)
+auto characters(std::string_view text) -> size_t
+{
+    return std::count_if(text.begin(), text.end(), [](char c) { return (c & 0xc0) != 0x80; });
+}
+
+// The first count characters of UTF-8 text (not splitting a character)
+auto first_characters(std::string_view text, size_t count) -> std::string_view
+{
+    for (size_t i = 0; i != text.size(); ++i)
+    {
+        if ((text[i] & 0xc0) != 0x80 && count-- == 0)
+            return text.substr(0, i);
+    }
+
+    return text;
+}
+}
+
+egmde::Catalogue::Catalogue(
+    std::vector<DesktopEntry const*> const& candidates, ExecutableIndex const& executables,
+    std::shared_ptr<CommandTrie const> commands) :
+    commands_{std::move(commands)}
+{
+    static size_t const title_size_limit = 30;
+
+    struct runnable
+    {
+        DesktopEntry const* app;
+        std::string program;
+        uint64_t collation_key;
+    };
+
+    std::vector<runnable> apps;
+    apps.reserve(candidates.size());
+
+    for (auto const app : candidates)
+    {
+        if (app->nodisplay || (app->tryexec && !executables.resolve(*app->tryexec)))
+            continue;
+
+        auto const args = split_command(app->exec, 1);
+        if (args.empty())
+            continue;
+
+        auto program = executables.resolve(args.front());
+        if (!program)
+            continue;
+
+        apps.push_back({app, std::move(*program), collation_key(app->name)});
+    }
+
+    // Sort by Name (preferring the shortest Exec) and keep the first of each Name
+    std::vector<uint32_t> order(apps.size());
+    for (uint32_t i = 0; i != order.size(); ++i)
+        order[i] = i;
+
+    std::sort(begin(order), end(order), [&apps](uint32_t lhs, uint32_t rhs)
+        {
+            auto const& l = apps[lhs];
+            auto const& r = apps[rhs];
+            if (l.collation_key != r.collation_key)
+                return l.collation_key < r.collation_key;
+            if (auto const c = l.app->name.compare(r.app->name))
+                return c < 0;
+            return l.app->exec.length() < r.app->exec.length();
+        });
+
+    order.erase(
+        std::unique(begin(order), end(order), [&apps](uint32_t lhs, uint32_t rhs)
+            { return apps[lhs].collation_key == apps[rhs].collation_key && apps[lhs].app->name == apps[rhs].app->name; }),
+        end(order));
+
+    // Many strings are shared (directories, generic icons, Exec and Name often match)
+    std::unordered_map<std::string_view, StringRef> interned;
+    auto const intern = [&](std::string_view text)
+        {
+            auto const i = interned.try_emplace(text, StringRef{uint32_t(strings.size()), uint32_t(text.size())});
+            if (i.second)
+                strings.append(text);
+            return i.first->second;
+        };
+
+    for (auto column : {&names, &titles, &execs, &icons, &desktop_dirs, &desktop_files, &programs})
+        column->reserve(order.size());
+    terminals.reserve(order.size());
+    usage_keys.reserve(order.size());
+
+    // Long names are only shortened for display (in a deque, so that text already interned stays put)
+    std::deque<std::string> shortened_titles;
+
+    for (auto const i : order)
+    {
+        auto const& app = *apps[i].app;
+
+        std::string_view title = app.name;
+        if (characters(title) > title_size_limit)
+            title = shortened_titles.emplace_back(std::string{first_characters(title, title_size_limit-3)} + "...");
+
+        names.push_back(intern(app.name));
+        titles.push_back(intern(title));
+        execs.push_back(intern(app.exec));
+        icons.push_back(intern(app.icon));
+        desktop_dirs.push_back(intern(app.desktop_dir));
+        desktop_files.push_back(intern(app.desktop_file));
+        programs.push_back(intern(apps[i].program));
+        terminals.push_back(app.terminal);
+        usage_keys.push_back(usage_key(app.desktop_dir, app.desktop_file));
+        max_title = std::max(max_title, characters(title));
+    }
+    strings.shrink_to_fit();
+
+    text_start.reserve(order.size() + 1);
+    name_end.reserve(order.size());
+    text_bytes.reserve(order.size());
+
+    for (auto const i : order)
+    {
+        auto const& app = *apps[i].app;
+        text_start.push_back(text.size());
+        append_lower(text, app.name);
+        name_end.push_back(text.size());
+        text += '\n';
+        append_lower(text, app.generic_name);
+        text += '\n';
+        append_lower(text, app.keywords);
+        text_bytes.push_back(bytes_of(std::string_view{text}.substr(text_start.back())));
+    }
+    text_start.push_back(text.size());
+
+    for (uint32_t app = 0; app != size(); ++app)
+    {
+        for (auto i = text_start[app]; i != text_start[app+1];)
+        {
+            while (i != text_start[app+1] && !is_word_char(text[i])) ++i;
+            auto const start = i;
+            while (i != text_start[app+1] && is_word_char(text[i])) ++i;
+
+            if (i != start)
+                words.push_back({start, i - start, app});
+        }
+    }
+
+    {
+        std::vector<std::pair<uint64_t, Word>> keyed;
+        keyed.reserve(words.size());
+        for (auto const& w : words)
+            keyed.emplace_back(collation_key(word_text(w)), w);
+
+        std::sort(begin(keyed), end(keyed), [this](auto const& lhs, auto const& rhs)
+            { return lhs.first < rhs.first || (lhs.first == rhs.first && word_text(lhs.second) < word_text(rhs.second)); });
+
+        for (size_t i = 0; i != words.size(); ++i)
+            words[i] = keyed[i].second;
+    }
+
+    by_usage_key.reserve(size());
+    for (size_type app = 0; app != size(); ++app)
+        by_usage_key.emplace(usage_keys[app], app);
+}
+
+auto egmde::Catalogue::operator[](size_type i) const -> Entry
+{
+    return {
+        str(names[i]), str(titles[i]), str(execs[i]), str(icons[i]),
+        str(desktop_dirs[i]), str(desktop_files[i]), str(programs[i]), terminals[i]};
+}
+
+auto egmde::Catalogue::memory_used() const -> size_t
+{
+    auto result = sizeof *this + strings.capacity() + text.capacity();
+
+    for (auto column : {&names, &titles, &execs, &icons, &desktop_dirs, &desktop_files, &programs})
+        result += column->capacity() * sizeof(StringRef);
+
+    result += terminals.capacity() / 8 + usage_keys.capacity() * sizeof(uint64_t);
+    result += (text_start.capacity() + name_end.capacity()) * sizeof(uint32_t) + words.capacity() * sizeof(Word);
+    result += text_bytes.capacity() * sizeof(uint64_t);
+
+    // Approximately: a node (key, value and next pointer) per entry, and the buckets
+    result += by_usage_key.size() * (sizeof(uint64_t) + sizeof(size_type) + sizeof(void*)) +
+        by_usage_key.bucket_count() * sizeof(void*);
+
+    return result;
+}
+
+auto egmde::Catalogue::search(std::string_view query, Matches const* within) const -> Matches
+{
+    std::vector<uint8_t> rank(size(), within ? no_match : 0);
+
+    if (within)
+    {
+        for (auto app : *within)
+            rank[app] = 0;
+    }
+
+    // Each (space separated) word of the query has to match: an app ranks as its worst match
+    for (size_t start = 0; start < query.size();)
+    {
+        auto const end = std::min(query.find(' ', start), query.size());
+        if (end != start)
+            rank_word(query.substr(start, end - start), rank);
+        start = end + 1;
+    }
+
+    // A counting sort by rank keeps the title order within each rank
+    uint32_t count[ranks] = {};
+    for (auto r : rank)
+    {
+        if (r != no_match)
+            ++count[r];
+    }
+
+    uint32_t total = 0;
+    for (auto& c : count)
+        total += std::exchange(c, total);
+
+    Matches result(total);
+    for (uint32_t app = 0; app != size(); ++app)
+    {
+        if (rank[app] != no_match)
+            result[count[rank[app]]++] = app;
+    }
+
+    return result;
+}
+
+void egmde::Catalogue::rank_word(std::string_view query_word, std::vector<uint8_t>& rank) const
+{
+    // Matches are ranked (best first): a word starting with the query word at the start of Name,
+    // in Name, or elsewhere; then the query word as a subsequence of Name, or of the rest, with
+    // fewer gaps being better.
+    static uint8_t const unranked = no_match - 1;
+    std::vector<uint8_t> word_rank(size(), unranked);
+
+    auto w = std::lower_bound(begin(words), end(words), query_word,
+        [this](Word const& w, std::string_view query_word) { return word_text(w) < query_word; });
+
+    for (; w != end(words) && starts_with(word_text(*w), query_word); ++w)
+    {
+        uint8_t const prefix_rank = w->offset == text_start[w->app] ? 0 : w->offset < name_end[w->app] ? 1 : 2;
+        word_rank[w->app] = std::min(word_rank[w->app], prefix_rank);
+    }
+
+    auto const word_bytes = bytes_of(query_word);
+
+    for (uint32_t app = 0; app != size(); ++app)
+    {
+        auto& r = word_rank[app];
+
+        if (rank[app] == no_match)
+        {
+            continue;
+        }
+        else if (r == unranked && (text_bytes[app] & word_bytes) != word_bytes)
+        {
+            r = no_match;
+        }
+        else if (r == unranked)
+        {
+            // Is the word a subsequence?
+            auto i = text_start[app];
+            auto const end = text_start[app+1];
+            auto first = end;
+            auto found = true;
+
+            for (auto c : query_word)
+            {
+                while (i != end && text[i] != c) ++i;
+                if (!(found = (i != end)))
+                    break;
+                first = std::min(first, i++);
+            }
+
+            if (!found)
+            {
+                r = no_match;
+            }
+            else
+            {
+                auto const gaps = std::min<uint32_t>(i - first - query_word.size(), 99);
+                r = (i <= name_end[app] ? subsequence_in_name : subsequence_elsewhere) + gaps;
+            }
+        }
+
+        rank[app] = std::max(rank[app], r);
+    }
+}
+
+void egmde::Catalogue::append_lower(std::string& query, std::string_view text)
+{
+    for (auto c : text)
+        query += (c & 0x80) ? c : static_cast<char>(tolower(c));
+}
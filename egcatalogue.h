@@ -0,0 +1,142 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGCATALOGUE_H
+#define EGMDE_EGCATALOGUE_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace egmde
+{
+class CommandTrie;
+class ExecutableIndex;
+struct DesktopEntry;
+
+// The applications offered by the launcher (in title order) and an index for searching them
+class Catalogue
+{
+public:
+    using size_type = uint32_t;
+    using Matches = std::vector<uint32_t>;
+
+    // The details of an app (valid for the life of the catalogue)
+    struct Entry
+    {
+        std::string_view name;
+        std::string_view title;
+        std::string_view exec;
+        std::string_view icon;
+        std::string_view desktop_dir;
+        std::string_view desktop_file;
+        std::string_view program;
+        bool terminal;
+    };
+
+    Catalogue() = default;
+
+    // The candidates that can be run (see ExecutableIndex) with duplicate names removed
+    Catalogue(
+        std::vector<DesktopEntry const*> const& candidates, ExecutableIndex const& executables,
+        std::shared_ptr<CommandTrie const> commands);
+
+    auto size() const -> size_type { return usage_keys.size(); }
+    auto empty() const -> bool { return usage_keys.empty(); }
+    auto operator[](size_type i) const -> Entry;
+    auto key(size_type i) const -> uint64_t { return usage_keys[i]; }
+
+    // The length (in characters) of the longest title
+    auto title_width() const -> size_t { return max_title; }
+
+    // The executables in PATH (if known)
+    auto commands() const -> CommandTrie const* { return commands_.get(); }
+
+    auto memory_used() const -> size_t;
+
+    auto find(uint64_t usage_key) const -> std::optional<size_type>
+    {
+        auto const i = by_usage_key.find(usage_key);
+        if (i == by_usage_key.end())
+            return std::nullopt;
+        return i->second;
+    }
+
+    // The apps matching a (non-empty, lower case) query, best first. When the query extends an earlier
+    // one pass the earlier matches as "within" so that only those are considered.
+    auto search(std::string_view query, Matches const* within = nullptr) const -> Matches;
+
+    // Appends typed text to a query (in the lower case search() expects)
+    static void append_lower(std::string& query, std::string_view text);
+
+private:
+    static uint8_t constexpr no_match = 255;
+    static uint8_t constexpr subsequence_in_name = 3;
+    static uint8_t constexpr subsequence_elsewhere = subsequence_in_name + 100;
+    static uint8_t constexpr ranks = subsequence_elsewhere + 100;
+
+    // Ranks the apps not yet excluded (rank != no_match) on one word of a query, keeping the worst rank
+    void rank_word(std::string_view query_word, std::vector<uint8_t>& rank) const;
+
+    // The apps are columns of references to (interned) strings
+    struct StringRef { uint32_t offset; uint32_t length; };
+    std::string strings;
+    std::vector<StringRef> names;
+    std::vector<StringRef> titles;
+    std::vector<StringRef> execs;
+    std::vector<StringRef> icons;
+    std::vector<StringRef> desktop_dirs;
+    std::vector<StringRef> desktop_files;
+    std::vector<StringRef> programs;
+    std::vector<bool> terminals;
+    std::vector<uint64_t> usage_keys;
+    size_t max_title = 0;
+
+    std::unordered_map<uint64_t, size_type> by_usage_key;
+    std::shared_ptr<CommandTrie const> commands_;
+
+    auto str(StringRef ref) const -> std::string_view { return {strings.data() + ref.offset, ref.length}; }
+
+    // The lower case Name, GenericName and Keywords of each app (separated by '\n')
+    std::string text;
+    std::vector<uint32_t> text_start;
+    std::vector<uint32_t> name_end;
+
+    // The bytes in each app's text (as bits of byte % 64): a query needing others can't match
+    std::vector<uint64_t> text_bytes;
+    static auto bytes_of(std::string_view text) -> uint64_t
+    {
+        uint64_t result = 0;
+        for (auto c : text)
+            result |= uint64_t{1} << (c & 63);
+        return result;
+    }
+
+    // Every word in text, sorted for prefix lookup
+    struct Word { uint32_t offset; uint32_t length; uint32_t app; };
+    std::vector<Word> words;
+
+    auto word_text(Word const& w) const -> std::string_view { return {text.data() + w.offset, w.length}; }
+};
+}
+
+#endif //EGMDE_EGCATALOGUE_H
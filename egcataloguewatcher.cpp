@@ -0,0 +1,321 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+
+#include "egcataloguewatcher.h"
+#include "egcatalogue.h"
+#include "egcommandtrie.h"
+#include "egdesktopentrycache.h"
+#include "egdesktopscan.h"
+#include "egexecutableindex.h"
+
+#include <mir/fd.h>
+#include <mir/log.h>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct egmde::CatalogueWatcher::Self
+{
+    explicit Self(std::function<void(std::shared_ptr<Catalogue const>)> publish) :
+        publish{std::move(publish)},
+        inotify{inotify_init1(IN_CLOEXEC|IN_NONBLOCK)},
+        shutdown_signal{eventfd(0, EFD_CLOEXEC)}
+    {
+        // The initial load happens on the watcher thread so that it doesn't delay startup
+        watcher = std::thread{[this] { run(); }};
+    }
+
+    ~Self()
+    {
+        if (watcher.joinable())
+        {
+            eventfd_write(shutdown_signal, 1);
+            watcher.join();
+        }
+    }
+
+    static auto const watch_mask =
+        IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+    // PATH directories: executables appearing, disappearing or being chmod'ed
+    static auto const path_watch_mask =
+        IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_MASK_ADD;
+
+    // Wait this long after a change for related changes (a package install touches many files)
+    static auto constexpr settle_ms = 200;
+
+    void add_watches(boost::filesystem::path const& path)
+    try
+    {
+        if (!is_directory(path))
+            return;
+
+        auto const wd = inotify_add_watch(inotify, path.c_str(), watch_mask);
+        if (wd < 0)
+            return;
+
+        watches[wd] = path.string();
+
+        for (boost::filesystem::directory_iterator i(path), end; i != end; ++i)
+        {
+            if (is_directory(*i))
+                add_watches(i->path());
+        }
+    }
+    catch (std::exception const&){}
+
+    auto current_entries() const -> std::vector<DesktopEntry const*>
+    {
+        std::vector<DesktopEntry const*> result;
+        result.reserve(entries.size());
+
+        for (auto const& entry : entries)
+            result.push_back(&entry.second);
+
+        return result;
+    }
+
+    void publish_catalogue()
+    {
+        auto apps = std::make_shared<Catalogue const>(current_entries(), executables, commands);
+        mir::log_debug("Application catalogue: %u apps, %zu KiB", apps->size(), apps->memory_used() / 1024);
+        publish(std::move(apps));
+    }
+
+    void load()
+    {
+        // This is background work: don't compete with the compositor (threads we start inherit this)
+        sched_param const param{0};
+        pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+        executables.load();
+        commands = std::make_shared<CommandTrie const>(executables.names());
+
+        for (auto& entry : load_desktop_entries(application_directories(), DesktopEntryCache::default_file()))
+        {
+            auto path = (boost::filesystem::path{entry.desktop_dir} / entry.desktop_file).string();
+            entries.emplace(std::move(path), std::move(entry));
+        }
+
+        publish_catalogue();
+    }
+
+    void run()
+    {
+        load();
+
+        if (inotify < 0)
+        {
+            mir::log_warning("Failed to watch application directories: %s", strerror(errno));
+            return;
+        }
+
+        for (auto const& path : application_directories())
+        {
+            add_watches(path);
+        }
+
+        for (auto const& path : executables.directories())
+        {
+            auto const wd = inotify_add_watch(inotify, path.c_str(), path_watch_mask);
+            if (wd >= 0)
+                path_watches[wd] = path;
+        }
+
+        enum FdIndices { changes = 0, shutdown, indices };
+
+        pollfd fds[indices] =
+            {
+                {inotify,         POLLIN, 0},
+                {shutdown_signal, POLLIN, 0},
+            };
+
+        std::set<std::string> changed_files;
+        std::set<std::string> added_dirs;
+        std::set<std::string> removed_dirs;
+        std::set<std::string> changed_path_dirs;
+
+        while (!(fds[shutdown].revents & (POLLIN | POLLERR)))
+        {
+            auto const timeout =
+                changed_files.empty() && added_dirs.empty() && removed_dirs.empty() && changed_path_dirs.empty() ?
+                -1 : settle_ms;
+
+            auto const ready = poll(fds, indices, timeout);
+            if (ready < 0 && errno != EINTR)
+            {
+                mir::log_warning("Stopped watching application directories: %s", strerror(errno));
+                return;
+            }
+
+            if (ready == 0)
+            {
+                apply(changed_files, added_dirs, removed_dirs, changed_path_dirs);
+                changed_files.clear();
+                added_dirs.clear();
+                removed_dirs.clear();
+                changed_path_dirs.clear();
+                continue;
+            }
+
+            if (!(fds[changes].revents & POLLIN))
+                continue;
+
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length;
+
+            while ((length = read(inotify, buffer, sizeof buffer)) > 0)
+            {
+                for (auto p = buffer; p < buffer + length;)
+                {
+                    auto const event = reinterpret_cast<inotify_event const*>(p);
+                    p += sizeof(inotify_event) + event->len;
+
+                    // A PATH directory may also be watched for desktop files
+                    auto const path_dir = path_watches.find(event->wd);
+                    if (path_dir != path_watches.end())
+                    {
+                        changed_path_dirs.insert(path_dir->second);
+                        if (event->mask & IN_IGNORED)
+                            path_watches.erase(path_dir);
+                    }
+
+                    auto const dir = watches.find(event->wd);
+                    if (dir == watches.end())
+                        continue;
+
+                    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                    {
+                        removed_dirs.insert(dir->second);
+                        if (event->mask & IN_IGNORED)
+                            watches.erase(dir);
+                        continue;
+                    }
+
+                    if (!event->len)
+                        continue;
+
+                    auto path = dir->second + "/" + event->name;
+
+                    if (event->mask & IN_ISDIR)
+                    {
+                        if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                            added_dirs.insert(std::move(path));
+                        else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                            removed_dirs.insert(std::move(path));
+                    }
+                    else if (is_desktop_file(event->name))
+                    {
+                        changed_files.insert(std::move(path));
+                    }
+                }
+            }
+        }
+    }
+
+    void apply(
+        std::set<std::string> const& changed_files, std::set<std::string> const& added_dirs,
+        std::set<std::string> const& removed_dirs, std::set<std::string> const& changed_path_dirs)
+    {
+        for (auto const& dir : changed_path_dirs)
+            executables.rescan(dir);
+
+        if (!changed_path_dirs.empty())
+            commands = std::make_shared<CommandTrie const>(executables.names());
+
+        for (auto const& dir : removed_dirs)
+        {
+            auto const prefix = dir + "/";
+            for (auto i = entries.lower_bound(prefix); i != entries.end() && i->first.compare(0, prefix.size(), prefix) == 0;)
+                i = entries.erase(i);
+
+            for (auto i = watches.begin(); i != watches.end();)
+            {
+                if (i->second == dir || i->second.compare(0, prefix.size(), prefix) == 0)
+                {
+                    inotify_rm_watch(inotify, i->first);
+                    i = watches.erase(i);
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+        }
+
+        file_list added;
+
+        for (auto const& dir : added_dirs)
+        {
+            add_watches(dir);
+            added.emplace_back(dir);
+        }
+
+        auto files = find_desktop_files(added);
+
+        for (auto const& file : changed_files)
+        {
+            boost::system::error_code error;
+            if (boost::filesystem::is_regular_file(file, error))
+                files.emplace_back(file);
+            else
+                entries.erase(file);
+        }
+
+        auto parsed = parse_desktop_files(files);
+        for (size_t i = 0; i != files.size(); ++i)
+            entries.insert_or_assign(files[i].string(), std::move(parsed[i]));
+
+        publish_catalogue();
+    }
+
+    std::function<void(std::shared_ptr<Catalogue const>)> const publish;
+    mir::Fd const inotify;
+    mir::Fd const shutdown_signal;
+
+    // Only accessed by the constructor and then the watcher thread
+    std::map<std::string, DesktopEntry> entries;
+    std::map<int, std::string> watches;
+    std::map<int, std::string> path_watches;
+    ExecutableIndex executables;
+    std::shared_ptr<CommandTrie const> commands;
+
+    std::thread watcher;
+};
+
+egmde::CatalogueWatcher::CatalogueWatcher(std::function<void(std::shared_ptr<Catalogue const>)> publish) :
+    self{std::make_unique<Self>(std::move(publish))}
+{
+}
+
+egmde::CatalogueWatcher::~CatalogueWatcher() = default;
@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+
+#ifndef EGMDE_EGCATALOGUEWATCHER_H
+#define EGMDE_EGCATALOGUEWATCHER_H
+
+#include <functional>
+#include <memory>
+
+namespace egmde
+{
+class Catalogue;
+
+// Keeps the catalogue of applications up to date as desktop files are added, changed or removed.
+// Only the affected desktop files are parsed, and a new catalogue is published for each batch of changes.
+// (Publishing happens on the watcher's thread.)
+class CatalogueWatcher
+{
+public:
+    explicit CatalogueWatcher(std::function<void(std::shared_ptr<Catalogue const>)> publish);
+    ~CatalogueWatcher();
+
+    CatalogueWatcher(CatalogueWatcher const&) = delete;
+    CatalogueWatcher& operator=(CatalogueWatcher const&) = delete;
+
+private:
+    struct Self;
+    std::unique_ptr<Self> const self;
+};
+}
+
+#endif //EGMDE_EGCATALOGUEWATCHER_H
@@ -0,0 +1,104 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "egcommandtrie.h"
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+
+namespace
+{
+auto starts_with(std::string_view text, std::string_view prefix) -> bool
+{
+    return text.substr(0, prefix.size()) == prefix;
+}
+}
+
+egmde::CommandTrie::CommandTrie(std::vector<std::string> names) :
+    names{std::move(names)}
+{
+    // Breadth first, so that the children of each node are contiguous (and sorted)
+    nodes.push_back({0, 0, uint32_t(this->names.size()), 0, '\0'});
+    std::deque<std::pair<uint32_t, uint32_t>> pending{{0, 0}};  // node, depth
+
+    while (!pending.empty())
+    {
+        auto const [index, depth] = pending.front();
+        pending.pop_front();
+
+        auto i = nodes[index].begin;
+        auto const end = nodes[index].end;
+        nodes[index].first_child = nodes.size();
+
+        if (end - i == 1)
+            continue;
+
+        if (i != end && this->names[i].size() == depth)
+            ++i;    // The name ending here
+
+        while (i != end)
+        {
+            auto const c = this->names[i][depth];
+            auto j = i;
+            while (j != end && this->names[j][depth] == c)
+                ++j;
+
+            nodes.push_back({0, i, j, 0, c});
+            pending.emplace_back(nodes.size() - 1, depth + 1);
+            i = j;
+        }
+
+        nodes[index].child_count = nodes.size() - nodes[index].first_child;
+    }
+}
+
+auto egmde::CommandTrie::complete(std::string_view prefix) const -> Completion
+{
+    auto const* n = &nodes[0];
+
+    for (size_t depth = 0; depth != prefix.size(); ++depth)
+    {
+        if (n->end - n->begin == 1)
+        {
+            // Only one name: the rest of it must match the prefix
+            if (!starts_with(names[n->begin], prefix))
+                return {prefix, 0, 0};
+            break;
+        }
+
+        auto const first = &nodes[n->first_child];
+        auto const child = std::find_if(first, first + n->child_count,
+            [c = prefix[depth]](Node const& child) { return child.c == c; });
+
+        if (child == first + n->child_count)
+            return {prefix, 0, 0};
+
+        n = child;
+    }
+
+    if (n->begin == n->end)
+        return {prefix, 0, 0};
+
+    // As the names are sorted, the candidates agree as far as the first and last do
+    auto const& first = names[n->begin];
+    auto const& last = names[n->end - 1];
+    auto const common = std::mismatch(first.begin(), first.end(), last.begin(), last.end()).first - first.begin();
+
+    return {std::string_view{first}.substr(0, std::max<size_t>(common, prefix.size())), n->begin, n->end};
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGCOMMANDTRIE_H
+#define EGMDE_EGCOMMANDTRIE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace egmde
+{
+// Completes commands from a (sorted, unique) list of names. The names below each node of the
+// trie are a contiguous range of the list, and a node with one name below it has no children.
+class CommandTrie
+{
+public:
+    explicit CommandTrie(std::vector<std::string> names);
+
+    // Views the names (or the prefix), so doesn't allocate
+    struct Completion
+    {
+        std::string_view text;  // The prefix, extended while the candidates agree
+        uint32_t begin = 0;     // The candidates are name(begin) to name(end - 1)
+        uint32_t end = 0;
+
+        auto count() const -> uint32_t { return end - begin; }
+    };
+
+    auto complete(std::string_view prefix) const -> Completion;
+
+    auto name(uint32_t i) const -> std::string_view { return names[i]; }
+
+private:
+    struct Node
+    {
+        uint32_t first_child;
+        uint32_t begin;
+        uint32_t end;
+        uint16_t child_count;
+        char c;
+    };
+
+    std::vector<std::string> const names;
+    std::vector<Node> nodes;
+};
+}
+
+#endif //EGMDE_EGCOMMANDTRIE_H
@@ -0,0 +1,323 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+// Times parsing the desktop files in the given directories (default /usr/share/applications)
+// with DesktopEntry, against the ifstream/getline parser it replaced. Then times loading
+// the directories with load_desktop_entries(), without a cache (cold) and with one (warm). Usage:
+//
+//      egmde-desktop-entry-benchmark [directory...]
+
+#include "egdesktopentry.h"
+#include "egdesktopscan.h"
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <streambuf>
+#include <vector>
+
+namespace
+{
+// The parser as it was, reading a stream a line at a time
+struct ReferenceEntry
+{
+    explicit ReferenceEntry(boost::filesystem::path const& desktop_path)
+    {
+        boost::filesystem::ifstream in(desktop_path);
+
+        desktop_dir = desktop_path.parent_path().string();
+        desktop_file = desktop_path.filename().string();
+
+        parse(in);
+    }
+
+    explicit ReferenceEntry(std::istream& in)
+    {
+        parse(in);
+    }
+
+    void parse(std::istream& in)
+    {
+        static std::string const name_key{"Name="};
+        static std::string const exec_key{"Exec="};
+
+        static std::string const tryexec_key{"TryExec="};
+        static std::string const hidden_key{"Hidden="};
+        static std::string const onlyshowin_key{"OnlyShowIn="};
+        static std::string const notshowin_key{"NotShowIn="};
+        static std::string const terminal_key{"Terminal="};
+        static std::string const nodisplay_key{"NoDisplay="};
+
+        std::string line;
+
+        auto in_desktop_entry = false;
+
+        while (std::getline(in, line))
+        {
+            if (line == "[Desktop Entry]")
+            {
+                in_desktop_entry = true;
+            }
+            else if (line.find("[Desktop Action") == 0)
+            {
+                in_desktop_entry = false;
+            }
+            else if (in_desktop_entry)
+            {
+                if (line.find(name_key) == 0 && name.empty())
+                    name = line.substr(name_key.length());
+                else if (line.find(exec_key) == 0)
+                    exec = unescape(line.substr(exec_key.length()));
+                else if (line.find(onlyshowin_key) == 0)
+                    onlyshowin = line.substr(onlyshowin_key.length());
+                else if (line.find(hidden_key) == 0)
+                    hidden = line.substr(hidden_key.length());
+                else if (line.find(tryexec_key) == 0)
+                    tryexec = line.substr(tryexec_key.length());
+                else if (line.find(notshowin_key) == 0)
+                    notshowin = line.substr(notshowin_key.length());
+                else if (line.find(terminal_key) == 0)
+                    terminal = line.substr(terminal_key.length()) == "true";
+                else if (line.find(nodisplay_key) == 0)
+                    nodisplay = line.substr(nodisplay_key.length()) == "true";
+            }
+        }
+
+        title = name;
+    }
+
+    static auto unescape(std::string const& in) -> std::string
+    {
+        std::string result;
+        bool escape = false;
+
+        for (auto c : in)
+        {
+            if (!(escape = (!escape && c == '\\')))
+                result += c;
+        }
+
+        return result;
+    }
+
+    std::string desktop_dir;
+    std::string desktop_file;
+
+    std::string name;
+    std::string exec;
+    std::string title;
+
+    std::optional<std::string> tryexec;
+    std::optional<std::string> hidden;
+    std::optional<std::string> onlyshowin;
+    std::optional<std::string> notshowin;
+    bool terminal = false;
+    bool nodisplay = false;
+};
+
+auto same(ReferenceEntry const& reference, egmde::DesktopEntry const& entry) -> bool
+{
+    return reference.name == entry.name && reference.exec == entry.exec &&
+        reference.tryexec == entry.tryexec && reference.hidden == entry.hidden &&
+        reference.onlyshowin == entry.onlyshowin && reference.notshowin == entry.notshowin &&
+        reference.terminal == entry.terminal && reference.nodisplay == entry.nodisplay;
+}
+
+struct Directory
+{
+    std::string path;
+    std::vector<std::string> files;
+};
+
+// Reads text from memory (without copying it like an istringstream)
+struct TextBuffer : std::streambuf
+{
+    explicit TextBuffer(std::string const& text)
+    {
+        auto const begin = const_cast<char*>(text.data());
+        setg(begin, begin, begin + text.size());
+    }
+};
+
+// The fastest of several runs of run_once (after a call to prepare), in microseconds
+template<typename Prepare, typename RunOnce>
+auto best_time(Prepare const& prepare, RunOnce const& run_once) -> double
+{
+    using namespace std::chrono;
+    auto best = duration<double, std::micro>::max();
+
+    for (auto run = 0; run != 10; ++run)
+    {
+        prepare();
+        auto const start = steady_clock::now();
+        run_once();
+        best = std::min<duration<double, std::micro>>(best, steady_clock::now() - start);
+    }
+
+    return best.count();
+}
+
+// Mean time per file of the fastest of several runs of parse_all
+template<typename ParseAll>
+auto time_per_file(size_t files, ParseAll const& parse_all) -> double
+{
+    return best_time([]{}, parse_all)/files;
+}
+
+auto same(std::vector<egmde::DesktopEntry> const& lhs, std::vector<egmde::DesktopEntry> const& rhs) -> bool
+{
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+        [](egmde::DesktopEntry const& l, egmde::DesktopEntry const& r)
+        {
+            return l.desktop_dir == r.desktop_dir && l.desktop_file == r.desktop_file &&
+                l.name == r.name && l.exec == r.exec && l.generic_name == r.generic_name &&
+                l.keywords == r.keywords && l.icon == r.icon && l.tryexec == r.tryexec &&
+                l.hidden == r.hidden && l.onlyshowin == r.onlyshowin && l.notshowin == r.notshowin &&
+                l.terminal == r.terminal && l.nodisplay == r.nodisplay;
+        });
+}
+}
+
+int main(int argc, char const* argv[])
+{
+    std::vector<Directory> directories;
+    size_t files = 0;
+
+    std::vector<char const*> paths{argv + 1, argv + argc};
+    if (paths.empty())
+        paths.push_back("/usr/share/applications");
+
+    for (auto const path : paths)
+    {
+        boost::system::error_code error;
+        for (boost::filesystem::recursive_directory_iterator i{path, error}, end; !error && i != end; i.increment(error))
+        {
+            if (i->path().extension() != ".desktop" || !is_regular_file(i->path(), error))
+                continue;
+
+            auto const dir = i->path().parent_path().string();
+            if (directories.empty() || directories.back().path != dir)
+                directories.push_back({dir, {}});
+
+            directories.back().files.push_back(i->path().filename().string());
+            ++files;
+        }
+    }
+
+    if (!files)
+    {
+        printf("No desktop files found\n");
+        return 1;
+    }
+
+    // Check that both parsers agree before timing them
+    std::vector<std::string> texts;
+    for (auto const& directory : directories)
+    {
+        for (auto const& file : directory.files)
+        {
+            auto const path = directory.path + "/" + file;
+            ReferenceEntry const reference{path};
+            if (!same(reference, egmde::DesktopEntry{path}))
+            {
+                printf("Parsers differ on %s\n", path.c_str());
+                return 1;
+            }
+
+            boost::filesystem::ifstream in{path};
+            texts.emplace_back(std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{});
+        }
+    }
+
+    auto const reference_file = time_per_file(files, [&]
+        {
+            for (auto const& directory : directories)
+                for (auto const& file : directory.files)
+                    ReferenceEntry{directory.path + "/" + file};
+        });
+
+    auto const entry_file = time_per_file(files, [&]
+        {
+            for (auto const& directory : directories)
+            {
+                int const dir_fd = open(directory.path.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+                for (auto const& file : directory.files)
+                    egmde::DesktopEntry{directory.path, file, dir_fd};
+                close(dir_fd);
+            }
+        });
+
+    // Without the file system: the text is already in memory
+    auto const reference_text = time_per_file(files, [&]
+        {
+            for (auto const& text : texts)
+            {
+                TextBuffer buffer{text};
+                std::istream in{&buffer};
+                ReferenceEntry{in};
+            }
+        });
+
+    auto const entry_text = time_per_file(files, [&]
+        {
+            for (auto const& text : texts)
+                egmde::DesktopEntry{}.parse(text);
+        });
+
+    // The whole scan (as at startup), first without the cache and then with it populated
+    egmde::file_list const scan_paths{paths.begin(), paths.end()};
+    auto const cache_file = boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path("egmde-benchmark-%%%%-%%%%");
+    auto const remove_cache = [&] { boost::system::error_code error; remove(cache_file, error); };
+
+    std::vector<egmde::DesktopEntry> cold_entries;
+    auto const cold_load = best_time(remove_cache, [&]
+        {
+            cold_entries = egmde::load_desktop_entries(scan_paths, cache_file);
+        });
+
+    std::vector<egmde::DesktopEntry> warm_entries;
+    auto const warm_load = best_time([]{}, [&]
+        {
+            warm_entries = egmde::load_desktop_entries(scan_paths, cache_file);
+        });
+
+    remove_cache();
+
+    if (!same(cold_entries, warm_entries))
+    {
+        printf("Cached entries differ from parsed entries\n");
+        return 1;
+    }
+
+    printf("%zu desktop files, mean time per file:\n", files);
+    printf("  reading files:  reference %6.2fus, DesktopEntry %6.2fus (%.1fx)\n",
+        reference_file, entry_file, reference_file/entry_file);
+    printf("  parsing text:   reference %6.2fus, DesktopEntry %6.2fus (%.1fx)\n",
+        reference_text, entry_text, reference_text/entry_text);
+    printf("%zu desktop entries, load_desktop_entries():\n", cold_entries.size());
+    printf("  cold (no cache): %8.2fms\n", cold_load/1000);
+    printf("  warm (cached):   %8.2fms (%.1fx)\n", warm_load/1000, cold_load/warm_load);
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "egdesktopentry.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+auto unescape(std::string_view in) -> std::string
+{
+    std::string result;
+    result.reserve(in.size());
+    bool escape = false;
+
+    for (auto c : in)
+    {
+        if (!(escape = (!escape && c == '\\')))
+            result += c;
+    }
+
+    return result;
+}
+
+auto starts_with(std::string_view text, std::string_view prefix) -> bool
+{
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+// The contents of a file: small files are read with a single read() into a
+// per-thread buffer (cheaper than mmap/munmap), large ones are mapped.
+class FileText
+{
+public:
+    FileText(int dir_fd, char const* path)
+    {
+        int const fd = openat(dir_fd, path, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        // Nearly every desktop file fits, so only stat (and map) a file that fills the buffer
+        thread_local std::vector<char> buffer(small_file);
+        auto const bytes = read(fd, buffer.data(), small_file);
+
+        if (0 < bytes && size_t(bytes) < small_file)
+        {
+            text_ = {buffer.data(), size_t(bytes)};
+        }
+        else if (struct stat info; size_t(bytes) == small_file && fstat(fd, &info) == 0)
+        {
+            size_t const length = info.st_size;
+            auto const mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                mapping_ = mapping;
+                text_ = {static_cast<char const*>(mapping), length};
+            }
+        }
+        close(fd);
+    }
+
+    ~FileText()
+    {
+        if (mapping_)
+            munmap(mapping_, text_.size());
+    }
+
+    FileText(FileText const&) = delete;
+    FileText& operator=(FileText const&) = delete;
+
+    auto text() const -> std::string_view { return text_; }
+
+private:
+    static size_t const small_file = 64*1024;
+    void* mapping_ = nullptr;
+    std::string_view text_;
+};
+}
+
+egmde::DesktopEntry::DesktopEntry(boost::filesystem::path const& desktop_path) :
+    desktop_dir{desktop_path.parent_path().string()},
+    desktop_file{desktop_path.filename().string()}
+{
+    FileText const file{AT_FDCWD, desktop_path.c_str()};
+    parse(file.text());
+}
+
+egmde::DesktopEntry::DesktopEntry(std::string desktop_dir, std::string desktop_file, int dir_fd) :
+    desktop_dir{std::move(desktop_dir)},
+    desktop_file{std::move(desktop_file)}
+{
+    FileText const file{dir_fd, this->desktop_file.c_str()};
+    parse(file.text());
+}
+
+void egmde::DesktopEntry::parse(std::string_view text)
+{
+    auto in_desktop_entry = false;
+
+    while (!text.empty())
+    {
+        auto const eol = text.find('\n');
+        auto const line = text.substr(0, eol);
+        text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+
+        if (line.empty())
+            continue;
+
+        // Only copy the values we keep, and only compare keys with the right initial
+        auto const value = [line](std::string_view key) -> std::optional<std::string_view>
+            {
+                if (starts_with(line, key))
+                    return line.substr(key.size());
+                return std::nullopt;
+            };
+
+        switch (line[0])
+        {
+        case '[':
+            if (line == "[Desktop Entry]")
+                in_desktop_entry = true;
+            else if (starts_with(line, "[Desktop Action"))
+                in_desktop_entry = false;
+            break;
+
+        case 'E':
+            if (!in_desktop_entry) break;
+            if (auto const v = value("Exec="))
+                exec = unescape(*v);
+            break;
+
+        case 'G':
+            if (!in_desktop_entry) break;
+            if (auto const v = value("GenericName="))
+            {
+                if (generic_name.empty())
+                    generic_name = *v;
+            }
+            break;
+
+        case 'H':
+            if (!in_desktop_entry) break;
+            if (auto const v = value("Hidden="))
+                hidden = *v;
+            break;
+
+        case 'I':
+            if (!in_desktop_entry) break;
+            if (auto const v = value("Icon="))
+                icon = *v;
+            break;
+
+        case 'K':
+            if (!in_desktop_entry) break;
+            if (auto const v = value("Keywords="))
+            {
+                if (keywords.empty())
+                    keywords = *v;
+            }
+            break;
+
+        case 'N':
+            if (!in_desktop_entry) break;
+            if (auto const v = value("Name="))
+            {
+                if (name.empty())
+                    name = *v;
+            }
+            else if (auto const v = value("NotShowIn="))
+                notshowin = *v;
+            else if (auto const v = value("NoDisplay="))
+                nodisplay = *v == "true";
+            break;
+
+        case 'O':
+            if (!in_desktop_entry) break;
+            if (auto const v = value("OnlyShowIn="))
+                onlyshowin = *v;
+            break;
+
+        case 'T':
+            if (!in_desktop_entry) break;
+            if (auto const v = value("TryExec="))
+                tryexec = *v;
+            else if (auto const v = value("Terminal="))
+                terminal = *v == "true";
+            break;
+
+        case 'X':
+            if (!in_desktop_entry) break;
+            if (auto const v = value("X-egmde-Priority="))
+                priority = atoi(std::string{*v}.c_str());
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+auto egmde::split_command(std::string const& command, size_t max_args) -> std::vector<std::string>
+{
+    std::vector<std::string> tokens;
+    std::string token;
+    char in_quote = '\0';
+    bool escaping = false;
+
+    auto push_token = [&]()
+    {
+        if (!token.empty())
+        {
+            tokens.push_back(std::move(token));
+            token.clear();
+        }
+    };
+
+    for (auto c : command)
+    {
+        if (tokens.size() == max_args)
+            break;
+
+        if (escaping)
+        {
+            // end escape
+            escaping = false;
+            token += c;
+            continue;
+        }
+
+        switch (c)
+        {
+        case '\\':
+            // start escape
+            escaping = true;
+            continue;
+
+        case '\'':
+        case '\"':
+            if (in_quote == '\0')
+            {
+                // start quoted sequence
+                in_quote = c;
+                continue;
+            }
+            else if (c == in_quote)
+            {
+                // end quoted sequence
+                in_quote = '\0';
+                continue;
+            }
+            else
+            {
+                break;
+            }
+
+        default:
+            break;
+        }
+
+        if (!isspace(c) || in_quote)
+        {
+            token += c;
+        }
+        else
+        {
+            push_token();
+        }
+    }
+
+    push_token();
+
+    return tokens;
+}
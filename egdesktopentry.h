@@ -0,0 +1,68 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGDESKTOPENTRY_H
+#define EGMDE_EGDESKTOPENTRY_H
+
+#include <boost/filesystem/path.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace egmde
+{
+// The keys of a desktop file's [Desktop Entry] group that egmde uses
+struct DesktopEntry
+{
+    DesktopEntry() = default;
+
+    DesktopEntry(boost::filesystem::path const& desktop_path);
+
+    // Reads desktop_file relative to dir_fd (an open descriptor for desktop_dir). That saves
+    // looking up the directory again for each of its files.
+    DesktopEntry(std::string desktop_dir, std::string desktop_file, int dir_fd);
+
+    // Sets the fields from the text of a desktop file
+    void parse(std::string_view text);
+
+    std::string desktop_dir;
+    std::string desktop_file;
+
+    std::string name;
+    std::string exec;
+    std::string generic_name;
+    std::string keywords;
+    std::string icon;
+
+    std::optional<std::string> tryexec;
+    std::optional<std::string> hidden;
+    std::optional<std::string> onlyshowin;
+    std::optional<std::string> notshowin;
+    bool terminal = false;
+    bool nodisplay = false;
+    int priority = 0;       // Only used for autostart entries (not cached)
+};
+
+// Splits a command line (such as an Exec value) into (at most max_args) arguments, honouring quotes and escapes
+auto split_command(std::string const& command, size_t max_args = SIZE_MAX) -> std::vector<std::string>;
+}
+
+#endif //EGMDE_EGDESKTOPENTRY_H
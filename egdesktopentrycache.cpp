@@ -0,0 +1,269 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "egdesktopentrycache.h"
+
+#include <mir/log.h>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+void put_u32(std::string& out, uint32_t value)
+{
+    out.append(reinterpret_cast<char const*>(&value), sizeof value);
+}
+
+void put_i64(std::string& out, int64_t value)
+{
+    out.append(reinterpret_cast<char const*>(&value), sizeof value);
+}
+
+void put_string(std::string& out, std::string const& value)
+{
+    put_u32(out, value.size());
+    out += value;
+}
+
+// Reads the fields written by put_*(), running off the end clears ok
+struct CacheReader
+{
+    CacheReader(char const* begin, char const* end) : next{begin}, end{end} {}
+
+    template<typename Int>
+    auto get_int() -> Int
+    {
+        Int result = 0;
+        if (ok && end - next >= static_cast<ptrdiff_t>(sizeof result))
+            memcpy(&result, next, sizeof result);
+        else
+            ok = false;
+        next += ok ? sizeof result : 0;
+        return result;
+    }
+
+    auto get_string() -> std::string
+    {
+        auto const length = get_int<uint32_t>();
+        if (!ok || static_cast<uint32_t>(end - next) < length)
+        {
+            ok = false;
+            return {};
+        }
+        next += length;
+        return {next - length, next};
+    }
+
+    char const* next;
+    char const* const end;
+    bool ok = true;
+};
+}
+
+auto egmde::DesktopEntryCache::default_file() -> boost::filesystem::path
+{
+    if (auto const cache_home = getenv("XDG_CACHE_HOME"))
+    {
+        return boost::filesystem::path{cache_home} / "egmde" / "desktop-entries";
+    }
+    else if (auto const home = getenv("HOME"))
+    {
+        return boost::filesystem::path{home} / ".cache" / "egmde" / "desktop-entries";
+    }
+
+    return {};
+}
+
+egmde::DesktopEntryCache::DesktopEntryCache(boost::filesystem::path cache_file) : file{std::move(cache_file)}
+{
+    updated = magic;
+
+    int const fd = file.empty() ? -1 : open(file.c_str(), O_RDONLY|O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        auto const mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            mapped = static_cast<char const*>(mapping);
+            mapped_size = info.st_size;
+        }
+    }
+    close(fd);
+
+    if (mapped_size < magic.size() || magic.compare(0, magic.size(), mapped, magic.size()) != 0)
+        return;
+
+    CacheReader reader{mapped + magic.size(), mapped + mapped_size};
+    while (reader.ok && reader.next != reader.end)
+    {
+        auto const record_start = reader.next;
+        auto dir = reader.get_string();
+        auto const length = reader.get_int<uint32_t>();
+
+        if (!reader.ok || static_cast<uint32_t>(reader.end - reader.next) < length)
+            break;
+
+        reader.next += length;
+        index[std::move(dir)] = {record_start, reader.next};
+    }
+}
+
+egmde::DesktopEntryCache::~DesktopEntryCache()
+{
+    if (mapped)
+        munmap(const_cast<char*>(mapped), mapped_size);
+}
+
+auto egmde::DesktopEntryCache::lookup(std::string const& dir, DirectoryScan& scan) const -> bool
+{
+    auto const record = index.find(dir);
+    if (record == index.end())
+        return false;
+
+    CacheReader reader{record->second.first, record->second.second};
+    reader.get_string();
+    reader.get_int<uint32_t>();
+
+    auto const sec = reader.get_int<int64_t>();
+    auto const nsec = reader.get_int<int64_t>();
+    if (!reader.ok || sec != scan.mtime.tv_sec || nsec != scan.mtime.tv_nsec)
+        return false;
+
+    std::vector<boost::filesystem::path> cached_subdirs;
+    for (auto n = reader.get_int<uint32_t>(); reader.ok && n--;)
+        cached_subdirs.emplace_back(reader.get_string());
+
+    std::vector<DesktopEntry> cached_entries;
+    for (auto n = reader.get_int<uint32_t>(); reader.ok && n--;)
+    {
+        DesktopEntry& entry = cached_entries.emplace_back();
+        entry.desktop_dir = dir;
+        entry.desktop_file = reader.get_string();
+        entry.name = reader.get_string();
+        entry.exec = reader.get_string();
+        entry.generic_name = reader.get_string();
+        entry.keywords = reader.get_string();
+        entry.icon = reader.get_string();
+
+        auto const flags = reader.get_int<uint8_t>();
+        entry.terminal = flags & terminal_flag;
+        entry.nodisplay = flags & nodisplay_flag;
+        if (flags & tryexec_flag) entry.tryexec = reader.get_string();
+        if (flags & hidden_flag) entry.hidden = reader.get_string();
+        if (flags & onlyshowin_flag) entry.onlyshowin = reader.get_string();
+        if (flags & notshowin_flag) entry.notshowin = reader.get_string();
+    }
+
+    if (!reader.ok)
+        return false;
+
+    scan.entries = std::move(cached_entries);
+    scan.subdirs = std::move(cached_subdirs);
+    scan.cached = {record->second.first, record->second.second};
+    return true;
+}
+
+void egmde::DesktopEntryCache::record(std::string const& dir, DirectoryScan const& scan)
+{
+    if (scan.cached.first)
+    {
+        updated.append(scan.cached.first, scan.cached.second);
+        ++hits;
+        return;
+    }
+
+    changed = true;
+
+    std::string body;
+    put_i64(body, scan.mtime.tv_sec);
+    put_i64(body, scan.mtime.tv_nsec);
+
+    put_u32(body, scan.subdirs.size());
+    for (auto const& subdir : scan.subdirs)
+        put_string(body, subdir.string());
+
+    put_u32(body, scan.entries.size());
+    for (auto const& entry : scan.entries)
+    {
+        put_string(body, entry.desktop_file);
+        put_string(body, entry.name);
+        put_string(body, entry.exec);
+        put_string(body, entry.generic_name);
+        put_string(body, entry.keywords);
+        put_string(body, entry.icon);
+
+        uint8_t const flags =
+            (entry.terminal ? terminal_flag : 0) |
+            (entry.nodisplay ? nodisplay_flag : 0) |
+            (entry.tryexec ? tryexec_flag : 0) |
+            (entry.hidden ? hidden_flag : 0) |
+            (entry.onlyshowin ? onlyshowin_flag : 0) |
+            (entry.notshowin ? notshowin_flag : 0);
+        body += static_cast<char>(flags);
+
+        if (entry.tryexec) put_string(body, *entry.tryexec);
+        if (entry.hidden) put_string(body, *entry.hidden);
+        if (entry.onlyshowin) put_string(body, *entry.onlyshowin);
+        if (entry.notshowin) put_string(body, *entry.notshowin);
+    }
+
+    put_string(updated, dir);
+    put_u32(updated, body.size());
+    updated += body;
+}
+
+void egmde::DesktopEntryCache::save() const
+{
+    if (file.empty() || (!changed && hits == index.size()))
+        return;
+
+    boost::system::error_code error;
+    boost::filesystem::create_directories(file.parent_path(), error);
+
+    boost::filesystem::path const temp{file.string() + "." + std::to_string(getpid())};
+    {
+        boost::filesystem::ofstream out{temp, std::ios::binary};
+        out.write(updated.data(), updated.size());
+        if (!out)
+        {
+            boost::filesystem::remove(temp, error);
+            return;
+        }
+    }
+
+    boost::filesystem::rename(temp, file, error);
+    if (error)
+    {
+        mir::log_warning("Failed to update desktop entry cache: %s", error.message().c_str());
+        boost::filesystem::remove(temp, error);
+    }
+}
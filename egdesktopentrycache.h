@@ -0,0 +1,98 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGDESKTOPENTRYCACHE_H
+#define EGMDE_EGDESKTOPENTRYCACHE_H
+
+#include "egdesktopentry.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <time.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace egmde
+{
+// What was found in a directory: the entries are either from the cache or parsed from files
+struct DirectoryScan
+{
+    timespec mtime{0, 0};
+    std::vector<boost::filesystem::path> subdirs;
+    std::vector<std::string> files;     // Names of the desktop files (when not cached)
+    std::vector<DesktopEntry> entries;
+    std::pair<char const*, char const*> cached{nullptr, nullptr};
+};
+
+// Parsed desktop entries for each directory, valid while the directory's mtime is unchanged.
+// (Package managers replace files rather than edit them in place, which updates the mtime.)
+//
+// Layout: magic, then for each directory: path, record length, mtime (s, ns), subdirectories, entries
+class DesktopEntryCache
+{
+public:
+    // $XDG_CACHE_HOME/egmde/desktop-entries
+    static auto default_file() -> boost::filesystem::path;
+
+    // An empty cache_file is an empty cache (that isn't saved)
+    explicit DesktopEntryCache(boost::filesystem::path cache_file);
+    ~DesktopEntryCache();
+
+    DesktopEntryCache(DesktopEntryCache const&) = delete;
+    DesktopEntryCache& operator=(DesktopEntryCache const&) = delete;
+
+    // If dir is unchanged fills in its entries and subdirectories and returns true.
+    // (Only reads the mapped cache, so may be called concurrently.)
+    auto lookup(std::string const& dir, DirectoryScan& scan) const -> bool;
+
+    // Records the content of a directory for save()
+    void record(std::string const& dir, DirectoryScan const& scan);
+
+    // Writes the cache if anything has changed since it was loaded
+    void save() const;
+
+private:
+    enum : uint8_t
+    {
+        terminal_flag = 1 << 0,
+        nodisplay_flag = 1 << 1,
+        tryexec_flag = 1 << 2,
+        hidden_flag = 1 << 3,
+        onlyshowin_flag = 1 << 4,
+        notshowin_flag = 1 << 5,
+    };
+
+    // Change the version when changing the layout
+    static inline std::string const magic{"egmde desktop entries v3\n"};
+
+    boost::filesystem::path const file;
+    char const* mapped = nullptr;
+    size_t mapped_size = 0;
+    std::unordered_map<std::string, std::pair<char const*, char const*>> index;
+
+    std::string updated;
+    bool changed = false;
+    size_t hits = 0;
+};
+}
+
+#endif //EGMDE_EGDESKTOPENTRYCACHE_H
@@ -0,0 +1,291 @@
+/*
+ * Copyright © 2016-2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "egdesktopscan.h"
+#include "egdesktopentrycache.h"
+#include "egparallel.h"
+
+#include <mir/fd.h>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+
+namespace
+{
+using egmde::file_list;
+
+void scan_directory_for_desktop_files(file_list& list, boost::filesystem::path const& path)
+try
+{
+    for (boost::filesystem::directory_iterator i(path), end; i != end; ++i)
+    {
+        if (is_directory(*i))
+        {
+            scan_directory_for_desktop_files(list, *i);
+        }
+        else if (egmde::is_desktop_file(i->path().filename().string()))
+        {
+            list.push_back(i->path());
+        }
+    }
+}
+catch (std::exception const&){}
+
+auto search_paths(char const* search_path) -> file_list
+{
+    file_list paths;
+
+    for (char const* start = search_path; char const* end = strchr(start, ':'); start = end+1)
+    {
+        if (start == end) continue;
+
+        if (strncmp(start, "~/", 2) != 0)
+        {
+            paths.push_back(boost::filesystem::path{start, end});
+        }
+        else
+        {
+            paths.push_back(boost::filesystem::path{getenv("HOME")} / boost::filesystem::path{start + 2, end});
+        }
+    }
+    return paths;
+}
+
+void scan_directory(egmde::DesktopEntryCache const& cache, boost::filesystem::path const& path, egmde::DirectoryScan& scan)
+try
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode))
+        return;
+
+    scan.mtime = info.st_mtim;
+
+    if (cache.lookup(path.string(), scan))
+        return;
+
+    for (boost::filesystem::directory_iterator i(path), end; i != end; ++i)
+    {
+        if (is_directory(*i))
+        {
+            scan.subdirs.push_back(i->path());
+        }
+        else if (auto name = i->path().filename().string(); egmde::is_desktop_file(name))
+        {
+            scan.files.push_back(std::move(name));
+        }
+    }
+}
+catch (std::exception const&){}
+
+// Collect entries in the same (depth first) order as a serial walk of the directories
+void merge_directory(
+    egmde::DesktopEntryCache& cache,
+    std::map<std::string, egmde::DirectoryScan>& scans,
+    std::string const& dir,
+    std::set<std::string>& recorded,
+    std::vector<egmde::DesktopEntry>& entries)
+{
+    auto const scan = scans.find(dir);
+    if (scan == scans.end() || !recorded.insert(dir).second)
+        return;
+
+    cache.record(dir, scan->second);
+    std::move(begin(scan->second.entries), end(scan->second.entries), back_inserter(entries));
+
+    for (auto const& subdir : scan->second.subdirs)
+    {
+        merge_directory(cache, scans, subdir.string(), recorded, entries);
+    }
+}
+}
+
+auto egmde::application_directories() -> file_list
+{
+    std::string search_path;
+    if (auto const* start = getenv("XDG_DATA_DIRS"))
+    {
+        for (auto const* end = start;
+            *end && ((end = strchr(start, ':')) || (end = strchr(start, '\0')));
+            start = end+1)
+        {
+            if (start == end) continue;
+
+            if (strncmp(start, "~/", 2) != 0)
+            {
+                search_path += std::string{start, end} + "/applications:";
+            }
+            else if (auto const home = getenv("HOME"))
+            {
+                search_path += home + std::string{start + 1, end} + "/applications:";
+            }
+        }
+    }
+    else
+    {
+        search_path = "/usr/local/share/applications:/usr/share/applications:/var/lib/snapd/desktop/applications:";
+    }
+
+    return search_paths(search_path.c_str());
+}
+
+auto egmde::autostart_files() -> file_list
+{
+    auto const home = getenv("HOME");
+
+    std::string search_path;
+    if (auto const* config_home = getenv("XDG_CONFIG_HOME"))
+    {
+        if (strncmp(config_home, "~/", 2) != 0)
+        {
+            search_path += std::string{config_home} + "/autostart:";
+        }
+        else
+        {
+            search_path += home + std::string{config_home + 1} + "/autostart:";
+        }
+    }
+    else
+    {
+        search_path += std::string{home} + "/.config/autostart:";
+    }
+
+    if (auto const* start = getenv("XDG_CONFIG_DIRS"))
+    {
+        for (auto const* end = start;
+             *end && ((end = strchr(start, ':')) || (end = strchr(start, '\0')));
+             start = end+1)
+        {
+            if (start == end) continue;
+
+            if (strncmp(start, "~/", 2) != 0)
+            {
+                search_path += std::string{start, end} + "/autostart:";
+            }
+            else
+            {
+                search_path += home + std::string{start + 1, end} + "/autostart:";
+            }
+        }
+    }
+    else
+    {
+        search_path += "/etc/xdg/autostart:";
+    }
+
+    return find_desktop_files(search_paths(search_path.c_str()));
+}
+
+auto egmde::is_desktop_file(std::string_view name) -> bool
+{
+    static std::string_view const desktop{".desktop"};
+
+    return name.size() >= desktop.size() && name.substr(name.size() - desktop.size()) == desktop;
+}
+
+auto egmde::find_desktop_files(file_list const& directories) -> file_list
+{
+    file_list list;
+
+    for (auto const& path : directories)
+    {
+        if (is_directory(path))
+        {
+            scan_directory_for_desktop_files(list, path);
+        }
+    }
+
+    return list;
+}
+
+auto egmde::parse_desktop_files(file_list const& files) -> std::vector<DesktopEntry>
+{
+    std::vector<DesktopEntry> result(files.size());
+    parallel_for(files.size(), [&](size_t i) { result[i] = DesktopEntry{files[i]}; });
+    return result;
+}
+
+// Directories are scanned (a level at a time) and files parsed in parallel, then merged in a
+// fixed order, so the result doesn't depend on the order the work completes.
+auto egmde::load_desktop_entries(file_list const& directories, boost::filesystem::path const& cache_file)
+    -> std::vector<DesktopEntry>
+{
+    DesktopEntryCache cache{cache_file};
+    std::map<std::string, DirectoryScan> scans;
+
+    for (auto level = directories; !level.empty();)
+    {
+        std::vector<DirectoryScan> results(level.size());
+        parallel_for(level.size(), [&](size_t i) { scan_directory(cache, level[i], results[i]); });
+
+        file_list next_level;
+        for (size_t i = 0; i != level.size(); ++i)
+        {
+            if (!scans.emplace(level[i].string(), std::move(results[i])).second)
+                continue;
+
+            for (auto const& subdir : scans[level[i].string()].subdirs)
+            {
+                if (scans.find(subdir.string()) == scans.end())
+                    next_level.push_back(subdir);
+            }
+        }
+
+        level = std::move(next_level);
+    }
+
+    // Each directory is opened once, and its files are opened relative to it
+    struct unparsed { std::string const* dir; int dir_fd; std::string const* file; DesktopEntry* entry; };
+    std::vector<mir::Fd> dir_fds;
+    std::vector<unparsed> files;
+    for (auto& scan : scans)
+    {
+        if (scan.second.cached.first || scan.second.files.empty())
+            continue;
+
+        dir_fds.emplace_back(open(scan.first.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC));
+        scan.second.entries.resize(scan.second.files.size());
+
+        for (size_t i = 0; i != scan.second.files.size(); ++i)
+            files.push_back({&scan.first, dir_fds.back(), &scan.second.files[i], &scan.second.entries[i]});
+    }
+
+    parallel_for(files.size(), [&](size_t i)
+        {
+            auto const& file = files[i];
+            *file.entry = DesktopEntry{*file.dir, *file.file, file.dir_fd};
+        });
+
+    std::vector<DesktopEntry> entries;
+    std::set<std::string> recorded;
+
+    for (auto const& path : directories)
+    {
+        merge_directory(cache, scans, path.string(), recorded, entries);
+    }
+
+    cache.save();
+    return entries;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGDESKTOPSCAN_H
+#define EGMDE_EGDESKTOPSCAN_H
+
+#include "egdesktopentry.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <string_view>
+#include <vector>
+
+namespace egmde
+{
+using file_list = std::vector<boost::filesystem::path>;
+
+// Where applications' desktop files are installed ($XDG_DATA_DIRS/applications)
+auto application_directories() -> file_list;
+
+// The autostart desktop files ($XDG_CONFIG_HOME/autostart and $XDG_CONFIG_DIRS/autostart)
+auto autostart_files() -> file_list;
+
+auto is_desktop_file(std::string_view name) -> bool;
+
+// The desktop files in the directories (and their subdirectories)
+auto find_desktop_files(file_list const& directories) -> file_list;
+
+// Parses the files in parallel
+auto parse_desktop_files(file_list const& files) -> std::vector<DesktopEntry>;
+
+// The desktop entries in the directories (and their subdirectories), in the order of a depth first
+// walk. Only directories that have changed since they were recorded in the cache file are read.
+// (An empty cache_file means nothing is cached.)
+auto load_desktop_entries(file_list const& directories, boost::filesystem::path const& cache_file)
+    -> std::vector<DesktopEntry>;
+}
+
+#endif //EGMDE_EGDESKTOPSCAN_H
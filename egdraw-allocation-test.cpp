@@ -0,0 +1,184 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+// Checks that, once warmed up, drawing launcher frames doesn't allocate. The frames are drawn
+// by the launcher's LauncherView, from a catalogue of apps: in the list and grid views, while
+// searching and in command mode (with completions). Exits with 77 (skipped) if there is no font.
+
+#include "egcatalogue.h"
+#include "egcommandtrie.h"
+#include "egdesktopentry.h"
+#include "egexecutableindex.h"
+#include "egfontservice.h"
+#include "egiconatlas.h"
+#include "eglauncherview.h"
+#include "egreadahead.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+// Only allocations by this (the drawing) thread are counted: the font, icon and readahead
+// services do their work on background threads
+thread_local bool counting = false;
+thread_local size_t allocations = 0;
+
+struct Buffer
+{
+    int32_t width;
+    int32_t height;
+    std::vector<unsigned char> pixels;
+};
+}
+
+void* operator new(size_t size)
+{
+    if (counting)
+        ++allocations;
+
+    if (auto const p = malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+int main()
+try
+{
+    try
+    {
+        egmde::FontService::instance().wait_for_font();
+    }
+    catch (std::exception const& e)
+    {
+        printf("Skipped (no font): %s\n", e.what());
+        return 77;
+    }
+
+    char const* const names[] = {
+        "Text Editor", "Terminal", "Files", "Web Browser", "Calculator", "Image Viewer", "Ελληνικά",
+        "Калькулятор", "Music", "Videos", "Settings", "System Monitor", "Disks", "Fonts", "Maps"};
+
+    std::vector<egmde::DesktopEntry> entries;
+    for (auto const name : names)
+    {
+        egmde::DesktopEntry entry;
+        entry.desktop_dir = "/usr/share/applications";
+        entry.desktop_file = std::string{name} + ".desktop";
+        entry.name = name;
+        entry.exec = "/bin/sh";
+        entry.icon = std::string{name} + " icon";
+        entries.push_back(std::move(entry));
+    }
+
+    std::vector<egmde::DesktopEntry const*> candidates;
+    for (auto const& entry : entries)
+        candidates.push_back(&entry);
+
+    auto const commands = std::make_shared<egmde::CommandTrie const>(std::vector<std::string>{
+        "less", "lessecho", "lesskey", "lesspipe", "link", "ln", "locale", "localedef", "logger", "login",
+        "logname", "look", "ls", "lsattr", "lsblk", "lscpu", "lsipc", "lslocks", "lsmem", "lsns"});
+
+    auto const apps = std::make_shared<egmde::Catalogue const>(candidates, egmde::ExecutableIndex{}, commands);
+    if (apps->size() != entries.size())
+    {
+        printf("Expected %zu apps in the catalogue, got %u\n", entries.size(), apps->size());
+        return EXIT_FAILURE;
+    }
+
+    egmde::Catalogue::Matches all_apps;
+    for (egmde::Catalogue::size_type i = 0; i != apps->size(); ++i)
+        all_apps.push_back(i);
+
+    std::string const query{"e"};
+    auto const matching_apps = apps->search(query);
+    egmde::Catalogue::Matches const* const visible_apps[] = {&all_apps, &matching_apps};
+
+    std::vector<Buffer> buffers;
+    buffers.push_back({1920, 1080, std::vector<unsigned char>(4*1920*1080)});
+    buffers.push_back({1280, 800, std::vector<unsigned char>(4*1280*800)});
+
+    egmde::IconAtlas icons{[]{}};
+    egmde::Readahead readahead;
+    egmde::LauncherView view{icons, readahead};
+
+    std::vector<std::string> icon_names;
+    for (auto const& entry : entries)
+        icon_names.push_back(entry.icon);
+    icons.icons(std::move(icon_names));
+
+    std::string const typed_commands[] = {"", "l", "ls", "lsb", "x", "ls -l"};
+
+    size_t frames = 0;
+    auto const draw = [&](Buffer& buffer, egmde::LauncherView::Selection const& selection)
+        {
+            view.prepare({&buffer, buffer.pixels.data(), buffer.width, buffer.height}, selection);
+            view.draw();
+            ++frames;
+        };
+
+    // On each output: moving through the apps in each view (with and without a search), and
+    // then typing commands. First to fill the caches, then counting.
+    for (auto pass = 0; pass != 3; ++pass)
+    {
+        counting = pass == 2;
+        frames = 0;
+
+        for (auto& buffer : buffers)
+        {
+            for (auto const grid : {false, true})
+            {
+                for (auto const visible : visible_apps)
+                {
+                    std::string_view const search = visible == &all_apps ? std::string_view{} : query;
+                    for (egmde::Catalogue::size_type current = 0; current != visible->size(); ++current)
+                        draw(buffer, {apps, visible, current, search, nullptr, true, grid, 0});
+                }
+            }
+
+            for (auto const& command : typed_commands)
+                draw(buffer, {apps, &all_apps, 0, {}, &command, true, false, 0});
+        }
+    }
+    counting = false;
+
+    printf("Allocations while drawing %zu warm frames: %zu\n", frames, allocations);
+    return allocations == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (std::exception const& e)
+{
+    printf("%s\n", e.what());
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "egexecutableindex.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string_view>
+
+void egmde::ExecutableIndex::load()
+{
+    auto const* path = getenv("PATH");
+    std::string_view remaining{path ? path : "/usr/local/bin:/usr/bin:/bin"};
+
+    while (!remaining.empty())
+    {
+        auto const colon = remaining.find(':');
+        auto const dir = remaining.substr(0, colon);
+        remaining.remove_prefix(colon == std::string_view::npos ? remaining.size() : colon + 1);
+
+        if (!dir.empty())
+        {
+            dirs.push_back(Directory{std::string{dir}, {}});
+            scan(dirs.back());
+        }
+    }
+}
+
+auto egmde::ExecutableIndex::names() const -> std::vector<std::string>
+{
+    std::vector<std::string> result;
+    for (auto const& dir : dirs)
+        result.insert(result.end(), dir.executables.begin(), dir.executables.end());
+
+    std::sort(begin(result), end(result));
+    result.erase(std::unique(begin(result), end(result)), end(result));
+    return result;
+}
+
+auto egmde::ExecutableIndex::directories() const -> std::vector<std::string>
+{
+    std::vector<std::string> result;
+    for (auto const& dir : dirs)
+        result.push_back(dir.path);
+    return result;
+}
+
+void egmde::ExecutableIndex::rescan(std::string const& path)
+{
+    for (auto& dir : dirs)
+    {
+        if (dir.path == path)
+            scan(dir);
+    }
+}
+
+auto egmde::ExecutableIndex::resolve(std::string const& program) const -> std::optional<std::string>
+{
+    if (program.find('/') != std::string::npos)
+    {
+        if (access(program.c_str(), X_OK) == 0)
+            return program;
+        return std::nullopt;
+    }
+
+    for (auto const& dir : dirs)
+    {
+        if (dir.executables.count(program))
+            return dir.path + "/" + program;
+    }
+
+    return std::nullopt;
+}
+
+void egmde::ExecutableIndex::scan(Directory& dir)
+{
+    dir.executables.clear();
+
+    auto const listing = opendir(dir.path.c_str());
+    if (!listing)
+        return;
+
+    while (auto const entry = readdir(listing))
+    {
+        if (entry->d_type == DT_DIR)
+            continue;
+
+        // Symlinks (and file systems without d_type) need checking that they aren't directories
+        struct stat sb;
+        if (entry->d_type != DT_REG &&
+            (fstatat(dirfd(listing), entry->d_name, &sb, 0) != 0 || !S_ISREG(sb.st_mode)))
+            continue;
+
+        if (faccessat(dirfd(listing), entry->d_name, X_OK, 0) == 0)
+            dir.executables.emplace(entry->d_name);
+    }
+
+    closedir(listing);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGEXECUTABLEINDEX_H
+#define EGMDE_EGEXECUTABLEINDEX_H
+
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace egmde
+{
+// The executables in each $PATH directory, so that entries can be checked and resolved without
+// probing the file system for each of them (or leaving exec to walk PATH at launch)
+class ExecutableIndex
+{
+public:
+    void load();
+
+    // All the executable names (sorted, without duplicates)
+    auto names() const -> std::vector<std::string>;
+
+    auto directories() const -> std::vector<std::string>;
+
+    void rescan(std::string const& path);
+
+    // An absolute (or relative) program is used as is, otherwise the first match in PATH order
+    auto resolve(std::string const& program) const -> std::optional<std::string>;
+
+private:
+    struct Directory
+    {
+        std::string path;
+        std::unordered_set<std::string> executables;
+    };
+
+    static void scan(Directory& dir);
+
+    std::vector<Directory> dirs;
+};
+}
+
+#endif //EGMDE_EGEXECUTABLEINDEX_H
@@ -0,0 +1,631 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "egfontservice.h"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+
+namespace
+{
+auto default_font() -> char const*
+{
+    static std::string result;
+
+    char const* const debian_path = "/usr/share/fonts/truetype/freefont/";
+    char const* const fedora_path = "/usr/share/fonts/gnu-free/";
+    char const* const fedora_path2= "/usr/share/fonts/liberation-sans/";
+    char const* const arch_path   = "/usr/share/fonts/TTF/";
+    char const* const snap_path   = "/snap/egmde/current/usr/share/fonts/truetype/freefont/";
+
+    char const* const default_files[] = { "FreeSansBold.ttf", "LiberationSans-Bold.ttf" };
+
+    for (auto const default_file : default_files)
+    {
+        for (auto const path : { debian_path, fedora_path, fedora_path2, arch_path, snap_path })
+        {
+            auto const full_path = std::string{path} + default_file;
+            if (access(full_path.c_str(), R_OK) == 0)
+            {
+                result = full_path;
+                return result.c_str();
+            }
+        }
+    }
+
+    return result.c_str();
+}
+
+// Faces to use for characters the main font lacks: any in EGMDE_FALLBACK_FONTS (colon separated)
+// and then those found in the usual places
+auto fallback_fonts() -> std::vector<std::string>
+{
+    std::vector<std::string> result;
+
+    if (auto const fonts = getenv("EGMDE_FALLBACK_FONTS"))
+    {
+        std::string const list{fonts};
+        for (size_t begin = 0, end; begin < list.size(); begin = end + 1)
+        {
+            end = std::min(list.find(':', begin), list.size());
+            if (end != begin)
+                result.push_back(list.substr(begin, end - begin));
+        }
+    }
+
+    char const* const default_fallbacks[] = {
+        // Latin, Greek and Cyrillic
+        "/usr/share/fonts/truetype/dejavu/DejaVuSans-Bold.ttf",
+        "/usr/share/fonts/dejavu-sans-fonts/DejaVuSans-Bold.ttf",
+        "/usr/share/fonts/TTF/DejaVuSans-Bold.ttf",
+        // CJK
+        "/usr/share/fonts/opentype/noto/NotoSansCJK-Bold.ttc",
+        "/usr/share/fonts/google-noto-cjk/NotoSansCJK-Bold.ttc",
+        "/usr/share/fonts/noto-cjk/NotoSansCJK-Bold.ttc",
+        "/usr/share/fonts/truetype/droid/DroidSansFallbackFull.ttf",
+        "/usr/share/fonts/google-droid-sans-fonts/DroidSansFallbackFull.ttf",
+        // Symbols and (monochrome) emoji
+        "/usr/share/fonts/truetype/noto/NotoEmoji-Regular.ttf",
+        "/usr/share/fonts/google-noto-emoji/NotoEmoji-Regular.ttf",
+        "/usr/share/fonts/truetype/ancient-scripts/Symbola_hint.ttf",
+        "/usr/share/fonts/gdouros-symbola/Symbola.ttf",
+    };
+
+    for (auto const path : default_fallbacks)
+    {
+        if (access(path, R_OK) == 0)
+            result.push_back(path);
+    }
+
+    return result;
+}
+
+auto font_error(char const* font_file) -> std::runtime_error
+{
+    return std::runtime_error{std::string{"WARNING: failed to load font: \""} +  font_file + "\"\n"
+        "(Hint: try setting EGMDE_FONT=<path to a font that exists>"};
+}
+
+// A read-only mapping of a whole file (optionally reading in the pages up front)
+struct MappedFile
+{
+    MappedFile(char const* path, bool populate)
+    {
+        auto const fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            auto const address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0);
+            if (address != MAP_FAILED)
+            {
+                data = static_cast<FT_Byte const*>(address);
+                size = info.st_size;
+            }
+        }
+
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (data)
+            munmap(const_cast<FT_Byte*>(data), size);
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    FT_Byte const* data = nullptr;
+    size_t size = 0;
+};
+
+// A face in the fallback chain (and the pixel size last set on it)
+struct Face
+{
+    std::unique_ptr<MappedFile> file;
+    FT_Face face = nullptr;
+    unsigned pixel_size = 0;
+};
+
+// Which face has each codepoint: pages of 256 face numbers (counting from 1, 0 meaning none)
+size_t const coverage_pages = 0x110000 >> 8;
+using CoveragePage = std::array<uint8_t, 256>;
+
+// Signed distance field glyphs are rendered once at this size, and hold distances up to the
+// spread (in reference pixels) either side of the outline
+unsigned const sdf_reference_size = 64;
+int const sdf_spread = 8;
+
+// Where a glyph's distance field is in the atlas, and where it goes relative to the pen
+// (measured in reference pixels)
+struct SdfGlyph
+{
+    size_t offset = 0;
+    int width = 0;
+    int height = 0;
+    float left = 0;
+    float top = 0;
+    float advance = 0;
+};
+
+// Squared distance from each sample to the nearest zero in f (Felzenszwalb & Huttenlocher)
+void distance_transform_1d(float* f, int n, int step, std::vector<float>& d, std::vector<int>& v, std::vector<float>& z)
+{
+    auto const inf = 1e20f;
+    auto const at = [&](int q) { return f[q*step]; };
+
+    v[0] = 0;
+    z[0] = -inf;
+    z[1] = inf;
+
+    for (int q = 1, k = 0; q != n; ++q)
+    {
+        auto s = ((at(q) + q*q) - (at(v[k]) + v[k]*v[k]))/(2*q - 2*v[k]);
+        while (s <= z[k])
+        {
+            --k;
+            s = ((at(q) + q*q) - (at(v[k]) + v[k]*v[k]))/(2*q - 2*v[k]);
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k+1] = inf;
+    }
+
+    for (int q = 0, k = 0; q != n; ++q)
+    {
+        while (z[k+1] < q)
+            ++k;
+        d[q] = (q - v[k])*(q - v[k]) + at(v[k]);
+    }
+
+    for (auto q = 0; q != n; ++q)
+        f[q*step] = d[q];
+}
+
+// Squared distance from each pixel to the nearest one where is_target is true
+template<typename Predicate>
+auto distance_transform(std::vector<bool> const& inside, int width, int height, Predicate is_target) -> std::vector<float>
+{
+    std::vector<float> result(inside.size());
+    for (size_t i = 0; i != inside.size(); ++i)
+        result[i] = is_target(inside[i]) ? 0 : 1e20f;
+
+    auto const n = std::max(width, height);
+    std::vector<float> d(n);
+    std::vector<int> v(n);
+    std::vector<float> z(n + 1);
+
+    for (auto x = 0; x != width; ++x)
+        distance_transform_1d(result.data() + x, height, width, d, v, z);
+
+    for (auto y = 0; y != height; ++y)
+        distance_transform_1d(result.data() + y*width, width, 1, d, v, z);
+
+    return result;
+}
+
+// Appends the distance field of an 8-bit coverage bitmap (padded by the spread) to the atlas
+void append_distance_field(
+    std::vector<unsigned char>& atlas, unsigned char const* coverage, int pitch, int width, int height)
+{
+    auto const field_width = width + 2*sdf_spread;
+    auto const field_height = height + 2*sdf_spread;
+
+    std::vector<bool> inside(field_width*field_height);
+    for (auto y = 0; y != height; ++y)
+    {
+        for (auto x = 0; x != width; ++x)
+            inside[(y + sdf_spread)*field_width + x + sdf_spread] = coverage[y*pitch + x] >= 0x80;
+    }
+
+    auto const to_inside = distance_transform(inside, field_width, field_height, [](bool in) { return in; });
+    auto const to_outside = distance_transform(inside, field_width, field_height, [](bool in) { return !in; });
+
+    // Stored so that 0x80 is the outline, and higher values are inside
+    for (size_t i = 0; i != inside.size(); ++i)
+    {
+        // (Measured between pixel centres: the outline is half a pixel nearer)
+        auto distance = std::sqrt(to_inside[i]) - std::sqrt(to_outside[i]);
+        distance += distance > 0 ? -0.5f : 0.5f;
+        auto const value = 0x80 - distance*0x7f/sdf_spread;
+        atlas.push_back(static_cast<unsigned char>(std::lround(std::clamp(value, 0.0f, 255.0f))));
+    }
+}
+}
+
+struct egmde::FontService::Self
+{
+    ~Self();
+
+    // Called with the mutex held
+    void load();
+    auto open_face(char const* path, bool populate) -> bool;
+    void index_coverage(Face const& face, uint8_t number);
+    auto face_for(char32_t ch) -> Face&;
+    void set_pixel_size(Face& face, unsigned pixel_size);
+    auto render(char32_t ch, unsigned pixel_size) -> std::shared_ptr<Glyph const>;
+    auto sdf_glyph(char32_t ch) -> SdfGlyph const&;
+    auto render_sdf(char32_t ch, unsigned pixel_size) -> std::shared_ptr<Glyph const>;
+
+    std::mutex mutex;
+    std::thread preloader;
+
+    enum class State { unloaded, loaded, failed } state = State::unloaded;
+    char const* font_file = nullptr;
+    FT_Library lib = nullptr;
+
+    // The main face, then the fallbacks (in order of preference)
+    std::vector<Face> faces;
+    std::vector<std::unique_ptr<CoveragePage>> coverage{coverage_pages};
+
+    // When enabled, glyphs are sampled from distance fields rather than rasterised for each size
+    bool const use_sdf = getenv("EGMDE_TEXT_SDF") && getenv("EGMDE_TEXT_SDF") != std::string{"0"};
+    std::vector<unsigned char> sdf_atlas;
+    std::unordered_map<char32_t, SdfGlyph> sdf_glyphs;
+
+    // The most recently used glyphs
+    using GlyphKey = std::tuple<FT_Face, unsigned, char32_t>;
+    static size_t const glyph_cache_size = 1024;
+    std::list<std::pair<GlyphKey, std::shared_ptr<Glyph const>>> glyphs;
+    std::map<GlyphKey, decltype(glyphs)::iterator> glyph_index;
+};
+
+egmde::FontService::Self::~Self()
+{
+    for (auto const& face : faces)
+        FT_Done_Face(face.face);
+
+    if (lib)
+        FT_Done_FreeType(lib);
+}
+
+void egmde::FontService::Self::load()
+{
+    if (state != State::unloaded)
+        return;
+
+    state = State::failed;
+
+    font_file = getenv("EGMDE_FONT");
+    if (!font_file) font_file = default_font();
+
+    if (FT_Init_FreeType(&lib))
+    {
+        lib = nullptr;
+        return;
+    }
+
+    if (!open_face(font_file, true))
+        return;
+
+    state = State::loaded;
+
+    // The fallbacks are only paged in as their glyphs are used
+    for (auto const& path : fallback_fonts())
+    {
+        if (faces.size() == UINT8_MAX)
+            break;
+
+        open_face(path.c_str(), false);
+    }
+
+    for (size_t i = 0; i != faces.size(); ++i)
+        index_coverage(faces[i], i + 1);
+
+    // The distance fields for printable ASCII are built up front (others as they are needed)
+    if (use_sdf)
+    {
+        for (char32_t ch = 0x20; ch != 0x7f; ++ch)
+            sdf_glyph(ch);
+    }
+}
+
+auto egmde::FontService::Self::open_face(char const* path, bool populate) -> bool
+{
+    Face result;
+    result.file = std::make_unique<MappedFile>(path, populate);
+    if (!result.file->data || FT_New_Memory_Face(lib, result.file->data, result.file->size, 0, &result.face))
+        return false;
+
+    // Glyphs are rendered at any size (so fixed size bitmap fonts, e.g. colour emoji, don't help)
+    if (!FT_IS_SCALABLE(result.face) || !result.face->charmap)
+    {
+        FT_Done_Face(result.face);
+        return false;
+    }
+
+    faces.push_back(std::move(result));
+    return true;
+}
+
+// Codepoints already covered by an earlier face keep that face
+void egmde::FontService::Self::index_coverage(Face const& face, uint8_t number)
+{
+    FT_UInt index;
+    for (auto ch = FT_Get_First_Char(face.face, &index); index; ch = FT_Get_Next_Char(face.face, ch, &index))
+    {
+        if (ch >= 0x110000)
+            break;
+
+        auto& page = coverage[ch >> 8];
+        if (!page)
+            page = std::make_unique<CoveragePage>(CoveragePage{});
+
+        auto& entry = (*page)[ch & 0xff];
+        if (!entry)
+            entry = number;
+    }
+}
+
+// The first face in the chain with the codepoint (or, if none has it, the main face)
+auto egmde::FontService::Self::face_for(char32_t ch) -> Face&
+{
+    if (ch < 0x110000)
+    {
+        if (auto const& page = coverage[ch >> 8])
+        {
+            if (auto const number = (*page)[ch & 0xff])
+                return faces[number - 1];
+        }
+    }
+
+    return faces.front();
+}
+
+void egmde::FontService::Self::set_pixel_size(Face& face, unsigned pixel_size)
+{
+    if (face.pixel_size != pixel_size)
+    {
+        FT_Set_Pixel_Sizes(face.face, pixel_size, 0);
+        face.pixel_size = pixel_size;
+    }
+}
+
+auto egmde::FontService::Self::render(char32_t ch, unsigned pixel_size) -> std::shared_ptr<Glyph const>
+{
+    if (use_sdf)
+        return render_sdf(ch, pixel_size);
+
+    auto& face = face_for(ch);
+    set_pixel_size(face, pixel_size);
+
+    FT_Load_Glyph(face.face, FT_Get_Char_Index(face.face, ch), FT_LOAD_DEFAULT);
+    auto const slot = face.face->glyph;
+    FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
+
+    auto const& bitmap = slot->bitmap;
+    auto result = std::make_shared<Glyph>();
+    result->left = slot->bitmap_left;
+    result->top = slot->bitmap_top;
+    result->width = bitmap.width;
+    result->rows = bitmap.rows;
+    result->advance = slot->advance.x >> 6;
+    result->alpha.resize(bitmap.width*bitmap.rows);
+
+    // Copied without the pitch padding
+    for (auto row = 0u; row != bitmap.rows; ++row)
+        std::copy_n(bitmap.buffer + row*bitmap.pitch, bitmap.width, result->alpha.data() + row*bitmap.width);
+
+    return result;
+}
+
+auto egmde::FontService::Self::sdf_glyph(char32_t ch) -> SdfGlyph const&
+{
+    if (auto const i = sdf_glyphs.find(ch); i != sdf_glyphs.end())
+        return i->second;
+
+    auto& face = face_for(ch);
+    set_pixel_size(face, sdf_reference_size);
+
+    FT_Load_Glyph(face.face, FT_Get_Char_Index(face.face, ch), FT_LOAD_DEFAULT);
+    auto const slot = face.face->glyph;
+    FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
+
+    auto const& bitmap = slot->bitmap;
+    SdfGlyph result;
+    result.advance = slot->advance.x/64.0f;
+
+    if (bitmap.width && bitmap.rows)
+    {
+        result.offset = sdf_atlas.size();
+        result.width = bitmap.width + 2*sdf_spread;
+        result.height = bitmap.rows + 2*sdf_spread;
+        result.left = slot->bitmap_left - sdf_spread;
+        result.top = slot->bitmap_top + sdf_spread;
+        append_distance_field(sdf_atlas, bitmap.buffer, bitmap.pitch, bitmap.width, bitmap.rows);
+    }
+
+    return sdf_glyphs[ch] = result;
+}
+
+// Scales a distance field to the pixel size: each pixel is one (bilinear) sample of the field
+auto egmde::FontService::Self::render_sdf(char32_t ch, unsigned pixel_size) -> std::shared_ptr<Glyph const>
+{
+    auto const& sdf = sdf_glyph(ch);
+    auto const scale = static_cast<float>(pixel_size)/sdf_reference_size;
+
+    auto result = std::make_shared<Glyph>();
+    result->advance = std::lround(sdf.advance*scale);
+
+    if (!sdf.width)
+        return result;
+
+    // Only pixels within half an output pixel of the outline can be covered, so only the part of
+    // the field that near to the glyph is sampled (x to the right of, and y below, the pen)
+    auto const margin = std::min(sdf_spread - 1.0f, 0.5f/scale + 1);
+    auto const x0 = static_cast<int>(std::floor((sdf.left + sdf_spread - margin)*scale));
+    auto const x1 = static_cast<int>(std::ceil((sdf.left + sdf.width - sdf_spread + margin)*scale));
+    auto const y0 = static_cast<int>(std::floor((sdf_spread - margin - sdf.top)*scale));
+    auto const y1 = static_cast<int>(std::ceil((sdf.height - sdf_spread + margin - sdf.top)*scale));
+    auto const width = x1 - x0;
+    auto const height = y1 - y0;
+
+    // Where each pixel samples the field (the padding keeps the samples inside it)
+    auto const position = [scale](int pixel, int limit, float origin, int& index, float& weight)
+        {
+            auto const f = std::clamp((pixel + 0.5f)/scale - origin - 0.5f, 0.0f, limit - 1.0f);
+            index = std::min(static_cast<int>(f), limit - 2);
+            weight = f - index;
+        };
+
+    std::vector<int> ix(width);
+    std::vector<float> wx(width);
+    for (auto x = 0; x != width; ++x)
+        position(x0 + x, sdf.width, sdf.left, ix[x], wx[x]);
+
+    // Coverage is linear in the field value: 0.5 at the outline, changing by 1 per output pixel
+    auto const slope = 0x7f/(sdf_spread*scale);
+    auto const* const field = sdf_atlas.data() + sdf.offset;
+
+    std::vector<unsigned char> alpha(width*height);
+    auto first_col = width, last_col = 0, first_row = height, last_row = 0;
+
+    for (auto y = 0; y != height; ++y)
+    {
+        int iy;
+        float wy;
+        position(y0 + y, sdf.height, -sdf.top, iy, wy);
+
+        auto const* const above = field + iy*sdf.width;
+        auto const* const below = above + sdf.width;
+
+        for (auto x = 0; x != width; ++x)
+        {
+            auto const i = ix[x];
+            auto const top = above[i] + (above[i+1] - above[i])*wx[x];
+            auto const bottom = below[i] + (below[i+1] - below[i])*wx[x];
+            auto const value = top + (bottom - top)*wy;
+
+            auto const coverage = std::clamp(0.5f + (value - 0x80)/slope, 0.0f, 1.0f);
+
+            if (auto const pixel = static_cast<unsigned char>(coverage*0xff + 0.5f))
+            {
+                alpha[y*width + x] = pixel;
+                first_col = std::min(first_col, x);
+                last_col = std::max(last_col, x + 1);
+                first_row = std::min(first_row, y);
+                last_row = std::max(last_row, y + 1);
+            }
+        }
+    }
+
+    if (first_col >= last_col)
+        return result;
+
+    // Trimmed to the pixels covered (so the metrics match a rasterised glyph)
+    result->left = x0 + first_col;
+    result->top = -(y0 + first_row);
+    result->width = last_col - first_col;
+    result->rows = last_row - first_row;
+    result->alpha.resize(result->width*result->rows);
+
+    for (auto row = 0u; row != result->rows; ++row)
+        std::copy_n(alpha.data() + (first_row + row)*width + first_col, result->width, result->alpha.data() + row*result->width);
+
+    return result;
+}
+
+egmde::FontService::FontService() :
+    self{std::make_unique<Self>()}
+{
+}
+
+egmde::FontService::~FontService()
+{
+    if (self->preloader.joinable())
+        self->preloader.join();
+}
+
+auto egmde::FontService::instance() -> FontService&
+{
+    static FontService service;
+    return service;
+}
+
+void egmde::FontService::preload()
+{
+    std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+
+    if (self->state == Self::State::unloaded && !self->preloader.joinable())
+    {
+        self->preloader = std::thread{[self=self.get()]
+            {
+                std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+                self->load();
+            }};
+    }
+}
+
+void egmde::FontService::wait_for_font()
+{
+    std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+    self->load();
+
+    if (self->state == Self::State::failed)
+        throw font_error(self->font_file);
+}
+
+auto egmde::FontService::glyph(char32_t ch, unsigned pixel_size) -> std::shared_ptr<Glyph const>
+{
+    std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+    self->load();
+
+    if (self->state == Self::State::failed)
+        throw font_error(self->font_file);
+
+    Self::GlyphKey key{self->face_for(ch).face, pixel_size, ch};
+
+    if (auto const i = self->glyph_index.find(key); i != self->glyph_index.end())
+    {
+        self->glyphs.splice(self->glyphs.begin(), self->glyphs, i->second);
+        return i->second->second;
+    }
+
+    self->glyphs.emplace_front(key, self->render(ch, pixel_size));
+    self->glyph_index[key] = self->glyphs.begin();
+
+    if (self->glyphs.size() > Self::glyph_cache_size)
+    {
+        self->glyph_index.erase(self->glyphs.back().first);
+        self->glyphs.pop_back();
+    }
+
+    return self->glyphs.front().second;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGFONTSERVICE_H
+#define EGMDE_EGFONTSERVICE_H
+
+#include <memory>
+#include <vector>
+
+namespace egmde
+{
+// The font shared by everything in the process that draws text. The font file is mapped into
+// memory once, and rendered glyphs are cached (most recently used). Safe to use from any thread.
+//
+// Characters the font lacks are drawn from the first of a chain of fallback fonts that has them
+// (EGMDE_FALLBACK_FONTS, then some commonly installed ones). Which face has each character is
+// indexed when the fonts are loaded.
+//
+// With EGMDE_TEXT_SDF set, each glyph is rasterised only once (as a signed distance field, kept in
+// an atlas) and glyphs of any size are sampled from that. This is cheaper when text is drawn at
+// many sizes (e.g. on outputs of different sizes) but the glyphs are not hinted.
+class FontService
+{
+public:
+    static auto instance() -> FontService&;
+
+    // Start loading the font in the background (so that it is ready before text is first drawn)
+    void preload();
+
+    // Waits for the font to be loaded (throws if it can't be)
+    void wait_for_font();
+
+    // A rendered glyph: its bitmap (positioned relative to the pen) and advance
+    struct Glyph
+    {
+        int left = 0;
+        int top = 0;
+        unsigned width = 0;
+        unsigned rows = 0;
+        int advance = 0;
+        std::vector<unsigned char> alpha;
+    };
+
+    auto glyph(char32_t ch, unsigned pixel_size) -> std::shared_ptr<Glyph const>;
+
+private:
+    FontService();
+    ~FontService();
+    FontService(FontService const&) = delete;
+    FontService& operator=(FontService const&) = delete;
+
+    struct Self;
+    std::unique_ptr<Self> const self;
+};
+}
+
+#endif //EGMDE_EGFONTSERVICE_H
@@ -26,10 +26,13 @@
 #include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <sys/poll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 #include <cstdlib>
 #include <sys/mman.h>
 #include <xkbcommon/xkbcommon.h>
 
+#include <algorithm>
 #include <cstring>
 #include <system_error>
 
@@ -145,6 +148,7 @@ void egmde::FullscreenClient::SurfaceInfo::clear_window()
     buffer = nullptr;
     shell_surface = nullptr;
     surface = nullptr;
+    standby = false;
 }
 
 void egmde::FullscreenClient::Output::done(void* data, struct wl_output* /*wl_output*/)
@@ -156,6 +160,7 @@ void egmde::FullscreenClient::Output::done(void* data, struct wl_output* /*wl_ou
 egmde::FullscreenClient::FullscreenClient(wl_display* display) :
     flush_signal{::eventfd(0, EFD_SEMAPHORE)},
     shutdown_signal{::eventfd(0, EFD_CLOEXEC)},
+    timer_signal{::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK)},
     keyboard_context_{xkb_context_new(XKB_CONTEXT_NO_FLAGS)},
     registry{nullptr, [](auto){}}
 {
@@ -164,6 +169,11 @@ egmde::FullscreenClient::FullscreenClient(wl_display* display) :
         BOOST_THROW_EXCEPTION((std::system_error{errno, std::system_category(), "Failed to create shutdown notifier"}));
     }
 
+    if (timer_signal == mir::Fd::invalid)
+    {
+        BOOST_THROW_EXCEPTION((std::system_error{errno, std::system_category(), "Failed to create timer"}));
+    }
+
     this->display = display;
 
     registry = {wl_display_get_registry(display), &wl_registry_destroy};
@@ -411,6 +421,7 @@ void egmde::FullscreenClient::run(wl_display* display)
         display_fd = 0,
         flush,
         shutdown,
+        timer,
         indices
     };
 
@@ -419,6 +430,7 @@ void egmde::FullscreenClient::run(wl_display* display)
             {wl_display_get_fd(display), POLLIN, 0},
             {flush_signal,               POLLIN, 0},
             {shutdown_signal,            POLLIN, 0},
+            {timer_signal,               POLLIN, 0},
         };
 
     while (!(fds[shutdown].revents & (POLLIN | POLLERR)))
@@ -455,6 +467,13 @@ void egmde::FullscreenClient::run(wl_display* display)
             eventfd_read(flush_signal, &foo);
             wl_display_flush(display);
         }
+
+        if (fds[timer].revents & (POLLIN | POLLERR))
+        {
+            uint64_t expirations;
+            if (read(timer_signal, &expirations, sizeof expirations) == sizeof expirations)
+                run_timed_actions();
+        }
     }
 }
 
@@ -484,6 +503,53 @@ void egmde::FullscreenClient::flush_wl() const
     eventfd_write(flush_signal, 1);
 }
 
+void egmde::FullscreenClient::call_after(std::chrono::steady_clock::duration delay, std::function<void()> action) const
+{
+    std::lock_guard<decltype(timer_mutex)> lock{timer_mutex};
+    timed_actions.emplace(std::chrono::steady_clock::now() + delay, std::move(action));
+    arm_timer();
+}
+
+void egmde::FullscreenClient::run_timed_actions()
+{
+    std::vector<std::function<void()>> due;
+
+    {
+        std::lock_guard<decltype(timer_mutex)> lock{timer_mutex};
+        auto const now = std::chrono::steady_clock::now();
+        auto const end = timed_actions.upper_bound(now);
+
+        for (auto i = begin(timed_actions); i != end; ++i)
+            due.push_back(std::move(i->second));
+
+        timed_actions.erase(begin(timed_actions), end);
+        arm_timer();
+    }
+
+    for (auto const& action : due)
+        action();
+
+    wl_display_flush(display);
+}
+
+// Requires timer_mutex to be held
+void egmde::FullscreenClient::arm_timer() const
+{
+    itimerspec spec{{0, 0}, {0, 0}};
+
+    if (!timed_actions.empty())
+    {
+        using namespace std::chrono;
+        auto const delay = std::max(
+            duration_cast<nanoseconds>(begin(timed_actions)->first - steady_clock::now()), nanoseconds{1});
+
+        spec.it_value.tv_sec = duration_cast<seconds>(delay).count();
+        spec.it_value.tv_nsec = (delay % seconds{1}).count();
+    }
+
+    timerfd_settime(timer_signal, 0, &spec, nullptr);
+}
+
 void egmde::FullscreenClient::keyboard_keymap(wl_keyboard* /*keyboard*/, uint32_t /*format*/, int32_t fd, uint32_t size)
 {
     char* keymap_string = static_cast<decltype(keymap_string)>(mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
@@ -24,6 +24,7 @@
 
 #include <wayland-client.h>
 
+#include <chrono>
 #include <functional>
 #include <map>
 #include <memory>
@@ -132,12 +133,18 @@ public:
         wl_surface* surface = nullptr;
         wl_shell_surface* shell_surface = nullptr;
         wl_buffer* buffer = nullptr;
+
+        // Unmapped (by attaching a null buffer) but kept for reuse
+        bool standby = false;
     };
 
     virtual void draw_screen(SurfaceInfo& info) const = 0;
 
     void for_each_surface(std::function<void(SurfaceInfo&)> const& f) const;
 
+    // Run action on the client thread once delay has elapsed
+    void call_after(std::chrono::steady_clock::duration delay, std::function<void()> action) const;
+
 protected:
 
     virtual void keyboard_keymap(wl_keyboard* keyboard, uint32_t format, int32_t fd, uint32_t size);
@@ -215,8 +222,15 @@ private:
     // Flush pending requests (on a safe thread)
     void flush_wl() const;
 
+    void run_timed_actions();
+    void arm_timer() const;
+
     mir::Fd const flush_signal;
     mir::Fd const shutdown_signal;
+    mir::Fd const timer_signal;
+
+    std::mutex mutable timer_mutex;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> mutable timed_actions;
 
     std::mutex mutable outputs_mutex;
     std::map<Output const*, SurfaceInfo> outputs;
@@ -0,0 +1,40 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGHASH_H
+#define EGMDE_EGHASH_H
+
+#include <cstdint>
+#include <string_view>
+
+namespace egmde
+{
+// FNV-1a. The hashes are stored in files, so this mustn't change. Pass an earlier result as h to
+// hash a sequence of strings.
+inline auto hash(std::string_view text, uint64_t h = 14695981039346656037u) -> uint64_t
+{
+    for (auto c : text)
+    {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211u;
+    }
+    return h;
+}
+}
+
+#endif //EGMDE_EGHASH_H
@@ -0,0 +1,149 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+// Checks that Icon= values are found in an icon theme: with dots in the name (as reverse-DNS
+// names have), or with the extension of the image file. The theme and atlas cache are in a
+// temporary directory.
+
+#include "egiconatlas.h"
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <png.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+int const size = 48;
+
+// A size x size PNG of one (opaque) colour
+auto write_icon(boost::filesystem::path const& file, uint8_t red, uint8_t green, uint8_t blue) -> bool
+{
+    png_image image;
+    memset(&image, 0, sizeof image);
+    image.version = PNG_IMAGE_VERSION;
+    image.width = size;
+    image.height = size;
+    image.format = PNG_FORMAT_RGBA;
+
+    std::vector<uint8_t> pixels;
+    for (auto i = 0; i != size*size; ++i)
+        pixels.insert(pixels.end(), {red, green, blue, 0xff});
+
+    return png_image_write_to_file(&image, file.c_str(), 0, pixels.data(), 0, nullptr);
+}
+
+struct Icon
+{
+    char const* file;       // In the theme
+    char const* name;       // The Icon= value
+    uint8_t blue;           // To tell them apart
+};
+}
+
+int main()
+{
+    char temp_template[] = "/tmp/egmde-icons-XXXXXX";
+    if (!mkdtemp(temp_template))
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    boost::filesystem::path const temp{temp_template};
+    auto const apps = temp / "data" / "icons" / "hicolor" / "48x48" / "apps";
+    boost::filesystem::create_directories(apps);
+
+    setenv("XDG_DATA_HOME", (temp / "data").c_str(), 1);
+    setenv("XDG_DATA_DIRS", (temp / "data").c_str(), 1);
+    setenv("XDG_CACHE_HOME", (temp / "cache").c_str(), 1);
+
+    Icon const icons[] = {
+        {"org.gnome.Calculator.png", "org.gnome.Calculator", 0x10},
+        {"org.gnome.png", "org.gnome", 0x20},
+        {"accessories-text-editor.png", "accessories-text-editor.png", 0x30},
+    };
+
+    auto failures = 0;
+
+    for (auto const& icon : icons)
+    {
+        if (!write_icon(apps / icon.file, 0xff, 0, icon.blue))
+        {
+            printf("Failed to write %s\n", icon.file);
+            boost::filesystem::remove_all(temp);
+            return EXIT_FAILURE;
+        }
+    }
+
+    {
+        std::mutex mutex;
+        std::condition_variable changed;
+        unsigned updates = 0;
+
+        egmde::IconAtlas atlas{[&]
+            {
+                std::lock_guard<decltype(mutex)> lock{mutex};
+                ++updates;
+                changed.notify_all();
+            }};
+
+        std::vector<std::string> names;
+        for (auto const& icon : icons)
+            names.emplace_back(icon.name);
+        atlas.icons(names);
+
+        std::vector<unsigned char> region(4*size*size);
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+
+        for (auto const& icon : icons)
+        {
+            // The atlas is built in the background (after the first request for its size)
+            std::unique_lock<decltype(mutex)> lock{mutex};
+            for (auto seen = updates; !atlas.draw(icon.name, size, size, size, region.data(), 0, 0); seen = updates)
+            {
+                if (!changed.wait_until(lock, deadline, [&] { return updates != seen; }))
+                    break;
+            }
+
+            // The middle pixel (BGRA)
+            auto const* const pixel = region.data() + 4*(size/2*size + size/2);
+            if (pixel[0] != icon.blue || pixel[2] != 0xff)
+            {
+                printf("Icon=%s: not drawn from %s\n", icon.name, icon.file);
+                ++failures;
+            }
+        }
+    }
+
+    boost::filesystem::remove_all(temp);
+
+    if (!failures)
+        printf("All %zu icons found\n", std::size(icons));
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
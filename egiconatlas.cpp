@@ -0,0 +1,604 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "egiconatlas.h"
+#include "eghash.h"
+
+#include <mir/log.h>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <png.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+auto modified(boost::filesystem::path const& path) -> int64_t
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return 0;
+
+    return info.st_mtim.tv_sec*1000000000LL + info.st_mtim.tv_nsec;
+}
+
+auto data_directories() -> std::vector<boost::filesystem::path>
+{
+    std::vector<boost::filesystem::path> result;
+
+    if (auto const data_home = getenv("XDG_DATA_HOME"))
+        result.emplace_back(data_home);
+    else if (auto const home = getenv("HOME"))
+        result.emplace_back(boost::filesystem::path{home} / ".local" / "share");
+
+    std::string const data_dirs = getenv("XDG_DATA_DIRS") ? getenv("XDG_DATA_DIRS") : "/usr/local/share:/usr/share";
+
+    for (std::string::size_type start = 0, end; start < data_dirs.size(); start = end + 1)
+    {
+        end = std::min(data_dirs.find(':', start), data_dirs.size());
+
+        if (end != start)
+            result.emplace_back(data_dirs.substr(start, end - start));
+    }
+
+    return result;
+}
+
+auto atlas_file(int size) -> boost::filesystem::path
+{
+    auto const name = "icons-" + std::to_string(size);
+
+    if (auto const cache_home = getenv("XDG_CACHE_HOME"))
+    {
+        return boost::filesystem::path{cache_home} / "egmde" / name;
+    }
+    else if (auto const home = getenv("HOME"))
+    {
+        return boost::filesystem::path{home} / ".cache" / "egmde" / name;
+    }
+
+    return {};
+}
+
+// An Icon= value is usually an icon name (which may contain dots, e.g. "org.gnome.Calculator"),
+// but some include the extension of an image file
+auto icon_name(std::string const& name) -> std::string
+{
+    for (std::string const extension : {".png", ".svg", ".xpm"})
+    {
+        if (name.size() > extension.size() &&
+            name.compare(name.size() - extension.size(), extension.size(), extension) == 0)
+            return name.substr(0, name.size() - extension.size());
+    }
+
+    return name;
+}
+
+// The PNG icons in the "hicolor" theme (which all themes fall back to) and in pixmaps.
+// The directories are only rescanned when one of them has changed.
+class IconTheme
+{
+public:
+    // The best file for an icon: the smallest at least size pixels, otherwise the largest
+    auto find(std::string const& name, int size) const -> std::string
+    {
+        if (name.empty())
+            return {};
+
+        if (name[0] == '/')
+            return boost::filesystem::path{name}.extension() == ".png" && access(name.c_str(), R_OK) == 0 ? name : "";
+
+        auto const i = icons.find(icon_name(name));
+        if (i == icons.end())
+            return {};
+
+        std::pair<int, std::string> const* best = nullptr;
+
+        for (auto const& candidate : i->second)
+        {
+            if (!best ||
+                (best->first < size && candidate.first > best->first) ||
+                (candidate.first >= size && candidate.first < best->first))
+            {
+                best = &candidate;
+            }
+        }
+
+        return best->second;
+    }
+
+    void refresh()
+    {
+        if (!scanned.empty() &&
+            std::all_of(begin(scanned), end(scanned), [](auto const& dir) { return modified(dir.first) == dir.second; }))
+        {
+            return;
+        }
+
+        scanned.clear();
+        icons.clear();
+
+        for (auto const& dir : data_directories())
+        {
+            auto const hicolor = dir / "icons" / "hicolor";
+            scanned.emplace_back(hicolor, modified(hicolor));
+
+            if (is_directory(hicolor))
+            {
+                for (boost::filesystem::directory_iterator i(hicolor), end; i != end; ++i)
+                {
+                    // e.g. "48x48", but not "scalable" or "symbolic"
+                    if (auto const size = atoi(i->path().filename().c_str()))
+                        scan(i->path() / "apps", size);
+                }
+            }
+
+            scan(dir / "pixmaps", 0);
+        }
+    }
+
+private:
+    void scan(boost::filesystem::path const& dir, int size)
+    try
+    {
+        scanned.emplace_back(dir, modified(dir));
+
+        if (!is_directory(dir))
+            return;
+
+        for (boost::filesystem::directory_iterator i(dir), end; i != end; ++i)
+        {
+            if (i->path().extension() == ".png")
+                icons[i->path().stem().string()].emplace_back(size, i->path().string());
+        }
+    }
+    catch (std::exception const&){}
+
+    std::vector<std::pair<boost::filesystem::path, int64_t>> scanned;
+    std::unordered_map<std::string, std::vector<std::pair<int, std::string>>> icons;
+};
+
+// Decode a PNG and scale it (preserving the aspect ratio) into the middle of a
+// size x size cell of premultiplied ARGB8888 pixels
+auto decode(std::string const& file, int size, std::string& cell) -> bool
+{
+    png_image image;
+    memset(&image, 0, sizeof image);
+    image.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_file(&image, file.c_str()))
+        return false;
+
+    image.format = PNG_FORMAT_BGRA;
+    std::vector<uint8_t> pixels(PNG_IMAGE_SIZE(image));
+
+    if (!png_image_finish_read(&image, nullptr, pixels.data(), 0, nullptr))
+    {
+        png_image_free(&image);
+        return false;
+    }
+
+    int const source_width = image.width;
+    int const source_height = image.height;
+
+    for (auto p = pixels.begin(); p != pixels.end(); p += 4)
+    {
+        for (auto c = 0; c != 3; ++c)
+            p[c] = (p[c]*p[3] + 127)/255;
+    }
+
+    auto const longest = std::max(source_width, source_height);
+    int const width = std::max(1, (source_width*size + longest/2)/longest);
+    int const height = std::max(1, (source_height*size + longest/2)/longest);
+
+    cell.assign(4*size*size, '\0');
+    auto* const dest = reinterpret_cast<uint8_t*>(&cell[0]) + 4*(((size - height)/2)*size + (size - width)/2);
+
+    // Each pixel is the average of the source pixels it covers
+    for (int y = 0; y != height; ++y)
+    {
+        int const y0 = y*source_height/height;
+        int const y1 = std::max(y0 + 1, (y+1)*source_height/height);
+
+        for (int x = 0; x != width; ++x)
+        {
+            int const x0 = x*source_width/width;
+            int const x1 = std::max(x0 + 1, (x+1)*source_width/width);
+
+            unsigned sum[4] = {};
+            for (auto sy = y0; sy != y1; ++sy)
+            {
+                for (auto sx = x0; sx != x1; ++sx)
+                {
+                    for (auto c = 0; c != 4; ++c)
+                        sum[c] += pixels[4*(sy*source_width + sx) + c];
+                }
+            }
+
+            unsigned const count = (y1 - y0)*(x1 - x0);
+            for (auto c = 0; c != 4; ++c)
+                dest[4*(y*size + x) + c] = (sum[c] + count/2)/count;
+        }
+    }
+
+    return true;
+}
+
+// An atlas file, mapped. It holds a header, an index (sorted by name), and the icons
+class Atlas
+{
+public:
+    struct Header
+    {
+        char magic[16];
+        uint32_t size;
+        uint32_t count;
+    };
+
+    struct Entry
+    {
+        uint64_t name;      // hash of the Icon= value
+        uint64_t source;    // hash of the file it came from
+        int64_t modified;   // of that file
+        uint32_t cell;
+        uint32_t unused;
+    };
+
+    // Change the version when changing the layout
+    static constexpr char magic[16] = "egmde icons v1\n";
+
+    static auto load(boost::filesystem::path const& file, int size) -> std::shared_ptr<Atlas const>
+    {
+        auto result = std::make_shared<Atlas>(file, size);
+        if (!result->header)
+            result.reset();
+        return result;
+    }
+
+    Atlas(boost::filesystem::path const& file, int size) : size{size}
+    {
+        int const fd = file.empty() ? -1 : open(file.c_str(), O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(Header))
+        {
+            auto const mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                mapped = static_cast<char const*>(mapping);
+                mapped_size = info.st_size;
+            }
+        }
+        close(fd);
+
+        if (!mapped)
+            return;
+
+        auto const candidate = reinterpret_cast<Header const*>(mapped);
+        auto const cells_offset = sizeof(Header) + candidate->count*sizeof(Entry);
+
+        if (memcmp(candidate->magic, magic, sizeof magic) != 0 ||
+            candidate->size != static_cast<uint32_t>(size) ||
+            mapped_size < cells_offset + candidate->count*cell_size())
+        {
+            return;
+        }
+
+        header = candidate;
+        entries = reinterpret_cast<Entry const*>(mapped + sizeof(Header));
+        cells = reinterpret_cast<uint8_t const*>(mapped + cells_offset);
+    }
+
+    ~Atlas()
+    {
+        if (mapped)
+            munmap(const_cast<char*>(mapped), mapped_size);
+    }
+
+    Atlas(Atlas const&) = delete;
+    Atlas& operator=(Atlas const&) = delete;
+
+    auto count() const -> uint32_t { return header->count; }
+
+    auto find(uint64_t name) const -> Entry const*
+    {
+        auto const end = entries + header->count;
+        auto const i = std::lower_bound(entries, end, name, [](Entry const& e, uint64_t name) { return e.name < name; });
+        return i != end && i->name == name ? i : nullptr;
+    }
+
+    auto pixels(Entry const& entry) const -> uint8_t const* { return cells + entry.cell*cell_size(); }
+
+    auto cell_size() const -> size_t { return 4*size*size; }
+
+private:
+    int const size;
+    char const* mapped = nullptr;
+    size_t mapped_size = 0;
+
+    Header const* header = nullptr;
+    Entry const* entries = nullptr;
+    uint8_t const* cells = nullptr;
+};
+
+// Update (or create) the atlas of size for names: only icons that are new or whose
+// file has changed are decoded. Returns existing if nothing changed.
+auto build(int size, std::vector<std::string> const& names, IconTheme const& theme,
+    std::shared_ptr<Atlas const> const& existing, std::atomic<bool> const& stopping) -> std::shared_ptr<Atlas const>
+{
+    std::map<uint64_t, Atlas::Entry> entries;
+    std::string cells;
+    std::string cell;
+    auto changed = !existing;
+
+    for (auto const& name : names)
+    {
+        if (stopping)
+            return existing;
+
+        auto const key = egmde::hash(name);
+        if (entries.count(key))
+            continue;
+
+        auto const file = theme.find(name, size);
+        if (file.empty())
+            continue;
+
+        Atlas::Entry entry{key, egmde::hash(file), modified(file), 0, 0};
+
+        if (auto const old = existing ? existing->find(key) : nullptr;
+            old && old->source == entry.source && old->modified == entry.modified)
+        {
+            cell.assign(reinterpret_cast<char const*>(existing->pixels(*old)), existing->cell_size());
+        }
+        else if (decode(file, size, cell))
+        {
+            changed = true;
+        }
+        else
+        {
+            continue;
+        }
+
+        entry.cell = entries.size();
+        entries[key] = entry;
+        cells += cell;
+    }
+
+    if (!changed && existing->count() == entries.size())
+        return existing;
+
+    Atlas::Header header;
+    memcpy(header.magic, Atlas::magic, sizeof header.magic);
+    header.size = size;
+    header.count = entries.size();
+
+    auto const file = atlas_file(size);
+    if (file.empty())
+        return existing;
+
+    boost::system::error_code error;
+    boost::filesystem::create_directories(file.parent_path(), error);
+
+    boost::filesystem::path const temp{file.string() + "." + std::to_string(getpid())};
+    {
+        boost::filesystem::ofstream out{temp, std::ios::binary};
+        out.write(reinterpret_cast<char const*>(&header), sizeof header);
+        for (auto const& entry : entries)
+            out.write(reinterpret_cast<char const*>(&entry.second), sizeof entry.second);
+        out.write(cells.data(), cells.size());
+
+        if (!out)
+        {
+            mir::log_warning("Failed to write icon atlas %s", temp.c_str());
+            boost::filesystem::remove(temp, error);
+            return existing;
+        }
+    }
+
+    boost::filesystem::rename(temp, file, error);
+    if (error)
+    {
+        mir::log_warning("Failed to update icon atlas: %s", error.message().c_str());
+        boost::filesystem::remove(temp, error);
+        return existing;
+    }
+
+    mir::log_debug("Icon atlas %s: %zu icons", file.c_str(), entries.size());
+    return Atlas::load(file, size);
+}
+
+// Porter-Duff "over" (for premultiplied ARGB8888) of the icon's rows [y0, y1) and columns [x0, x1)
+// onto the region with the icon at x, y
+void blend(uint8_t const* icon, int size, unsigned char* region, int stride, int x, int y, int x0, int x1, int y0, int y1)
+{
+    for (auto row = y0; row != y1; ++row)
+    {
+        auto const* src = icon + 4*(row*size + x0);
+        auto* dst = region + (y + row)*stride + 4*(x + x0);
+
+        for (auto col = x0; col != x1; ++col, src += 4, dst += 4)
+        {
+            if (auto const alpha = src[3])
+            {
+                for (auto c = 0; c != 4; ++c)
+                    dst[c] = src[c] + (dst[c]*(255 - alpha) + 127)/255;
+            }
+        }
+    }
+}
+}
+
+struct egmde::IconAtlas::Self
+{
+    explicit Self(std::function<void()> ready) : ready{std::move(ready)} {}
+
+    void run();
+
+    std::function<void()> const ready;
+
+    std::mutex mutable mutex;
+    std::condition_variable mutable wakeup;
+    std::atomic<bool> stopping{false};
+
+    std::vector<std::string> names;
+    bool have_names = false;
+    std::set<int> mutable sizes;    // Requested by draw()
+    std::set<int> mutable pending;  // Sizes to (re)build
+    std::map<int, std::shared_ptr<Atlas const>> atlases;
+
+    std::thread worker;
+};
+
+void egmde::IconAtlas::Self::run()
+{
+    // This is background work: don't compete with the compositor
+    sched_param const param{0};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+    IconTheme theme;
+
+    std::unique_lock<decltype(mutex)> lock{mutex};
+
+    while (!stopping)
+    {
+        wakeup.wait(lock, [this] { return stopping || !pending.empty(); });
+
+        if (stopping)
+            break;
+
+        auto const size = *pending.begin();
+        pending.erase(pending.begin());
+
+        auto const existing = atlases[size];
+        auto const wanted = names;
+        auto const update = have_names;
+
+        lock.unlock();
+
+        auto atlas = existing;
+
+        // Use what we have from last time while checking it is up to date
+        if (!atlas && (atlas = Atlas::load(atlas_file(size), size)))
+        {
+            {
+                std::lock_guard<decltype(mutex)> publish{mutex};
+                atlases[size] = atlas;
+            }
+            ready();
+        }
+
+        if (update)
+        {
+            theme.refresh();
+
+            if (auto const updated = build(size, wanted, theme, atlas, stopping); updated != atlas)
+            {
+                {
+                    std::lock_guard<decltype(mutex)> publish{mutex};
+                    atlases[size] = updated;
+                }
+                ready();
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+egmde::IconAtlas::IconAtlas(std::function<void()> ready) :
+    self{std::make_unique<Self>(std::move(ready))}
+{
+    self->worker = std::thread{[this] { self->run(); }};
+}
+
+egmde::IconAtlas::~IconAtlas()
+{
+    {
+        std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+        self->stopping = true;
+    }
+    self->wakeup.notify_one();
+    self->worker.join();
+}
+
+void egmde::IconAtlas::icons(std::vector<std::string> names)
+{
+    {
+        std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+        self->names = std::move(names);
+        self->have_names = true;
+        self->pending = self->sizes;
+    }
+    self->wakeup.notify_one();
+}
+
+auto egmde::IconAtlas::draw(std::string_view name, int size,
+    int32_t width, int32_t height, unsigned char* region_address, int x, int y) const -> bool
+{
+    std::shared_ptr<Atlas const> atlas;
+
+    {
+        std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+
+        if (self->sizes.insert(size).second)
+        {
+            self->pending.insert(size);
+            self->wakeup.notify_one();
+        }
+
+        auto const i = self->atlases.find(size);
+        if (i != self->atlases.end())
+            atlas = i->second;
+    }
+
+    auto const* const entry = atlas ? atlas->find(egmde::hash(name)) : nullptr;
+    if (!entry)
+        return false;
+
+    // Clip to the region
+    auto const x0 = std::max(0, -x);
+    auto const y0 = std::max(0, -y);
+    auto const x1 = std::min(size, width - x);
+    auto const y1 = std::min(size, height - y);
+
+    if (x0 < x1 && y0 < y1)
+        blend(atlas->pixels(*entry), size, region_address, 4*width, x, y, x0, x1, y0, y1);
+
+    return true;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGICONATLAS_H
+#define EGMDE_EGICONATLAS_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace egmde
+{
+// Application icons, looked up in the icon theme, decoded and scaled once for each pixel
+// size into an atlas file ($XDG_CACHE_HOME/egmde/icons-<size>) that is mapped for drawing.
+// The lookup, decoding and scaling all happen on a background thread.
+class IconAtlas
+{
+public:
+    // ready is called (from the background thread) when more icons become available
+    explicit IconAtlas(std::function<void()> ready);
+    ~IconAtlas();
+
+    // The icons needed (the Icon= values of the desktop files)
+    void icons(std::vector<std::string> names);
+
+    // Blend the named icon (size x size) into an ARGB8888 region at x, y.
+    // Returns false (and arranges for it to be prepared) if the icon isn't available yet.
+    auto draw(std::string_view name, int size,
+        int32_t width, int32_t height, unsigned char* region_address, int x, int y) const -> bool;
+
+private:
+    struct Self;
+    std::unique_ptr<Self> const self;
+};
+}
+
+#endif //EGMDE_EGICONATLAS_H
@@ -17,319 +17,48 @@
  */
 
 #include "eglauncher.h"
+#include "egcatalogue.h"
+#include "egcataloguewatcher.h"
+#include "egcommandtrie.h"
+#include "egdesktopentry.h"
+#include "egdesktopscan.h"
 #include "egfullscreenclient.h"
-#include "printer.h"
+#include "egiconatlas.h"
+#include "eglauncherview.h"
+#include "egreadahead.h"
+#include "egusagestore.h"
 
 #include <mir/log.h>
 #include <linux/input.h>
 #include <xkbcommon/xkbcommon.h>
 
-#include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <atomic>
-#include <condition_variable>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
-#include <exception>
-#include <iostream>
 #include <mutex>
 #include <optional>
+#include <set>
 #include <string>
+#include <string_view>
 #include <utility>
-#include <vector>
-#include <thread>
-
 #include <vector>
 #include <mir/geometry/size.h>
-#include <set>
 
 using namespace miral;
 
 namespace
 {
-using file_list = std::vector<boost::filesystem::path>;
-
-auto list_desktop_files() -> file_list;
-
-auto ends_with_desktop(std::string const &full_string) -> bool
-{
-    static const std::string desktop{".desktop"};
-
-    if (full_string.length() < desktop.length())
-        return false;
-
-    return !full_string.compare(full_string.length() - desktop.length(), desktop.length(), desktop);
-}
-
-void scan_directory_for_desktop_files(file_list& list, boost::filesystem::path const& path)
-try
-{
-    for (boost::filesystem::directory_iterator i(path), end; i != end; ++i)
-    {
-        if (is_directory(*i))
-        {
-            scan_directory_for_desktop_files(list, *i);
-        }
-        else if (ends_with_desktop(i->path().filename().string()))
-        {
-            list.push_back(i->path());
-        }
-    }
-}
-catch (std::exception const&){}
-
-auto scan_for_desktop_files(std::vector<boost::filesystem::path> const& paths) -> file_list
-{
-    file_list list;
-
-    for (auto const& path : paths)
-    {
-        if (is_directory(path))
-        {
-            scan_directory_for_desktop_files(list, path);
-        }
-    }
-
-    return list;
-}
-
-auto search_paths(char const* search_path) -> file_list
-{
-    file_list paths;
-
-    for (char const* start = search_path; char const* end = strchr(start, ':'); start = end+1)
-    {
-        if (start == end) continue;
-
-        if (strncmp(start, "~/", 2) != 0)
-        {
-            paths.push_back(boost::filesystem::path{start, end});
-        }
-        else
-        {
-            paths.push_back(boost::filesystem::path{getenv("HOME")} / boost::filesystem::path{start + 2, end});
-        }
-    }
-    return paths;
-}
-
-auto unescape(std::string const& in) -> std::string
-{
-    std::string result;
-    bool escape = false;
-
-    for (auto c : in)
-    {
-        if (!(escape = (!escape && c == '\\')))
-            result += c;
-    }
-
-    return result;
-}
-
-struct app_details
-{
-    app_details(boost::filesystem::path const& desktop_path)
-    {
-        static std::string const categories_key{"Categories="};
-        static std::string const name_key{"Name="};
-        static std::string const exec_key{"Exec="};
-        static std::string const icon_key{"Icon="};
-
-        static std::string const tryexec_key{"TryExec="};
-        static std::string const hidden_key{"Hidden="};
-        static std::string const onlyshowin_key{"OnlyShowIn="};
-        static std::string const notshowin_key{"NotShowIn="};
-        static std::string const terminal_key{"Terminal="};
-        static std::string const nodisplay_key{"NoDisplay="};
-
-        boost::filesystem::ifstream in(desktop_path);
-
-        std::string line;
-
-        desktop_dir = desktop_path.parent_path().string();
-        desktop_file = desktop_path.filename().string();
-
-        auto in_desktop_entry = false;
-
-        while (std::getline(in, line))
-        {
-            if (line == "[Desktop Entry]")
-            {
-                in_desktop_entry = true;
-            }
-            else if (line.find("[Desktop Action") == 0)
-            {
-                in_desktop_entry = false;
-            }
-            else if (in_desktop_entry)
-            {
-                if (line.find(name_key) == 0 && name.empty())
-                    name = line.substr(name_key.length());
-                else if (line.find(exec_key) == 0)
-                    exec = unescape(line.substr(exec_key.length()));
-                else if (line.find(onlyshowin_key) == 0)
-                    onlyshowin = line.substr(onlyshowin_key.length());
-                else if (line.find(hidden_key) == 0)
-                    hidden = line.substr(hidden_key.length());
-                else if (line.find(tryexec_key) == 0)
-                    tryexec = line.substr(tryexec_key.length());
-                else if (line.find(notshowin_key) == 0)
-                    notshowin = line.substr(notshowin_key.length());
-                else if (line.find(terminal_key) == 0)
-                    terminal = line.substr(terminal_key.length()) == "true";
-                else if (line.find(nodisplay_key) == 0)
-                    nodisplay = line.substr(nodisplay_key.length()) == "true";
-            }
-        }
-
-        title = name;
-    }
-
-    std::string desktop_dir;
-    std::string desktop_file;
-
-    std::string name;
-    std::string exec;
-    std::string title;
-
-    std::optional<std::string> tryexec;
-    std::optional<std::string> hidden;
-    std::optional<std::string> onlyshowin;
-    std::optional<std::string> notshowin;
-    bool terminal = false;
-    bool nodisplay = false;
-};
-
-auto load_details(file_list const& desktop_listing) -> std::vector<app_details>
-{
-    std::vector<app_details> details;
-
-    for (auto const& desktop_path : desktop_listing)
-    {
-            details.emplace_back(desktop_path);
-    }
-
-    details.erase(
-        std::remove_if(begin(details), end(details),
-            [](app_details const& app)
-                { return app.nodisplay; }),
-        end(details));
-
-    std::sort(begin(details), end(details),
-        [](app_details const& lhs, app_details const& rhs)
-            { return lhs.title <  rhs.title ||
-                    (lhs.title == rhs.title && lhs.exec.length() < rhs.exec.length()); });
-
-    details.erase(
-        std::unique(begin(details), end(details),
-            [](app_details const& lhs, app_details const& rhs)
-                { return lhs.title == rhs.title; }),
-        end(details));
-
-    std::string::size_type max_length = 0;
-
-    static auto const title_size_limit = 30;
-    for (auto& detail : details)
-    {
-        if (detail.title.size() > title_size_limit)
-        {
-            detail.title = detail.title.substr(0, title_size_limit-3) + "...";
-        }
-        max_length = std::max(max_length, detail.title.size());
-    }
-
-    for (auto& detail : details)
-    {
-        auto const pl = (max_length - detail.title.size()) / 2;
-        detail.title.insert(0, pl, ' ');
-        detail.title.insert(detail.title.size(), pl, ' ');
-    }
-
-    return details;
-}
-
-auto list_desktop_files() -> file_list
-{
-    std::string search_path;
-    if (auto const* start = getenv("XDG_DATA_DIRS"))
-    {
-        for (auto const* end = start;
-            *end && ((end = strchr(start, ':')) || (end = strchr(start, '\0')));
-            start = end+1)
-        {
-            if (start == end) continue;
-
-            if (strncmp(start, "~/", 2) != 0)
-            {
-                search_path += std::string{start, end} + "/applications:";
-            }
-            else if (auto const home = getenv("HOME"))
-            {
-                search_path += home + std::string{start + 1, end} + "/applications:";
-            }
-        }
-    }
-    else
-    {
-        search_path = "/usr/local/share/applications:/usr/share/applications:/var/lib/snapd/desktop/applications:";
-    }
-
-    auto const paths = search_paths(search_path.c_str());
-    return scan_for_desktop_files(paths);
-}
-
-auto list_autostart_files() -> file_list
-{
-    auto const home = getenv("HOME");
-
-    std::string search_path;
-    if (auto const* config_home = getenv("XDG_CONFIG_HOME"))
-    {
-        if (strncmp(config_home, "~/", 2) != 0)
-        {
-            search_path += std::string{config_home} + "/autostart:";
-        }
-        else
-        {
-            search_path += home + std::string{config_home + 1} + "/autostart:";
-        }
-    }
-    else
-    {
-        search_path += std::string{home} + "/.config/autostart:";
-    }
-
-    if (auto const* start = getenv("XDG_CONFIG_DIRS"))
-    {
-        for (auto const* end = start;
-             *end && ((end = strchr(start, ':')) || (end = strchr(start, '\0')));
-             start = end+1)
-        {
-            if (start == end) continue;
-
-            if (strncmp(start, "~/", 2) != 0)
-            {
-                search_path += std::string{start, end} + "/autostart:";
-            }
-            else
-            {
-                search_path += home + std::string{start + 1, end} + "/autostart:";
-            }
-        }
-    }
-    else
-    {
-        search_path += "/etc/xdg/autostart:";
-    }
-
-    auto const paths = search_paths(search_path.c_str());
-    return scan_for_desktop_files(paths);
-}
-
-auto run_app(ExternalClientLauncher& external_client_launcher, std::string app, egmde::Launcher::Mode mode) -> pid_t
+// If given, program is the resolved path of the first token of app
+auto run_app(
+    ExternalClientLauncher& external_client_launcher, std::string app, egmde::Launcher::Mode mode,
+    std::string const& program = {}) -> pid_t
 {
     auto ws = app.find('%');
     if (ws != std::string::npos)
@@ -374,70 +103,11 @@ auto run_app(ExternalClientLauncher& external_client_launcher, std::string app,
     case egmde::Launcher::Mode::wayland:
     case egmde::Launcher::Mode::x11:
     {
-        std::string token;
-        char in_quote = '\0';
-        bool escaping = false;
-
-        auto push_token = [&]()
-        {
-            if (!token.empty())
-            {
-                command.push_back(std::move(token));
-                token.clear();
-            }
-        };
+        auto tokens = egmde::split_command(app);
+        if (!program.empty() && !tokens.empty())
+            tokens.front() = program;
 
-        for (auto c : app)
-        {
-            if (escaping)
-            {
-                // end escape
-                escaping = false;
-                token += c;
-                continue;
-            }
-
-            switch (c)
-            {
-            case '\\':
-                // start escape
-                escaping = true;
-                continue;
-
-            case '\'':
-            case '\"':
-                if (in_quote == '\0')
-                {
-                    // start quoted sequence
-                    in_quote = c;
-                    continue;
-                }
-                else if (c == in_quote)
-                {
-                    // end quoted sequence
-                    in_quote = '\0';
-                    continue;
-                }
-                else
-                {
-                    break;
-                }
-
-            default:
-                break;
-            }
-
-            if (!isspace(c) || in_quote)
-            {
-                token += c;
-            }
-            else
-            {
-                push_token();
-            }
-        }
-
-        push_token();
+        command.insert(command.end(), std::make_move_iterator(tokens.begin()), std::make_move_iterator(tokens.end()));
     }
         break;
     }
@@ -456,13 +126,13 @@ auto run_app(ExternalClientLauncher& external_client_launcher, std::string app,
     }
 }
 
-void do_autostart(ExternalClientLauncher& external_client_launcher)
+void do_autostart(egmde::StartupScheduler& startup)
 {
-    auto const desktop_listing = list_autostart_files();
+    auto const desktop_listing = egmde::autostart_files();
 
     std::set<std::string> encountered_files;
 
-    for (app_details const autostart : desktop_listing)
+    for (egmde::DesktopEntry const autostart : desktop_listing)
     {
         if (encountered_files.insert(autostart.desktop_file).second == false)
             continue;
@@ -476,27 +146,46 @@ void do_autostart(ExternalClientLauncher& external_client_launcher)
         if (autostart.notshowin && autostart.notshowin->find("egmde") != std::string::npos)
             continue;
 
-        mir::log_info("autostarting: '%s'", autostart.exec.c_str());
-        run_app(external_client_launcher, autostart.exec, egmde::Launcher::Mode::wayland);
+        startup.schedule(autostart.desktop_file, autostart.exec, autostart.priority);
     }
 }
 }
 
 struct egmde::Launcher::Self : egmde::FullscreenClient
 {
-    Self(wl_display* display, ExternalClientLauncher& external_client_launcher, std::string terminal_cmd);
+    Self(wl_display* display, ExternalClientLauncher& external_client_launcher, std::string terminal_cmd,
+        LaunchTimes& launch_times);
 
     void draw_screen(SurfaceInfo& info) const override;
     void show_screen(SurfaceInfo& info) const;
-    static void clear_screen(SurfaceInfo& info) ;
+    void clear_screen(SurfaceInfo& info) const;
 
     void start();
 
 private:
+    void use_latest_catalogue() const;
+    auto visible_size() const -> Catalogue::size_type;
+    auto visible_index(Catalogue::size_type i) const -> Catalogue::size_type;
+    auto visible(Catalogue::size_type i) const -> Catalogue::Entry;
+    void reset_query() const;
+    void order_by_use() const;
+    void select(uint64_t usage_key) const;
+
+    auto extend_query(std::string_view text) -> bool;
+    auto shorten_query() -> bool;
+    auto clear_query() -> bool;
+    void start_command();
+    auto command_key(xkb_keysym_t keysym) -> bool;
     void prev_app();
     void next_app();
+    void move_selection(int delta);
+    void toggle_grid();
     void run_app(Mode mode = Mode::wayland);
 
+    // Selects the app in the grid at a point on a surface, running it if it was already selected (or if
+    // run_now). Returns false if the grid isn't shown on the surface.
+    auto grid_click(wl_surface* surface, int x, int y, bool run_now) -> bool;
+
     void keyboard_key(wl_keyboard* keyboard, uint32_t serial, uint32_t time, uint32_t key, uint32_t state) override;
     void keyboard_leave(wl_keyboard* keyboard, uint32_t serial, wl_surface* surface) override;
 
@@ -512,25 +201,77 @@ private:
 
     ExternalClientLauncher& external_client_launcher;
     std::string const terminal_cmd;
+    LaunchTimes& launch_times;
 
+    wl_surface* pointer_surface = nullptr;
+    int pointer_x = 0;
     int pointer_y = 0;
     int height = 0;
 
-    std::vector<app_details> const apps = load_details(list_desktop_files());
-
-    std::vector<app_details>::const_iterator current_app{apps.begin()};
     std::atomic<bool> running{false};
     std::atomic<Output const*> mutable showing{nullptr};
+
+    // Hidden surfaces are kept (with their buffers) this long in case they are shown again
+    static auto constexpr standby_timeout = std::chrono::seconds{60};
+    std::atomic<unsigned> mutable standby_generation{0};
+
+    // Prepares the selected app for launching
+    Readahead mutable readahead;
+
+    // The most recent catalogue (replaced, never modified, by the watcher thread)
+    std::shared_ptr<Catalogue const> latest{std::make_shared<Catalogue const>()};
+    std::atomic<bool> loaded{false};
+
+    // The catalogue in use, the search and the selected app, guarded by selection_mutex
+    std::mutex mutable selection_mutex;
+    std::shared_ptr<Catalogue const> mutable apps;
+    UsageStore usage{UsageStore::default_file()};
+    Catalogue::Matches mutable ordered;                 // The apps by use (then title)
+    std::string mutable query;
+    bool query_typed = false;                           // Since the launcher was shown
+    std::vector<Catalogue::Matches> mutable narrowing;  // The matches as each character was typed
+    Catalogue::size_type mutable current_app = 0;       // Index into the visible apps
+    std::optional<std::string> command;                 // Being typed (in command mode)
+
+    std::atomic<bool> grid_view{false};                 // Toggled with F2
+    std::atomic<unsigned> mutable view_generation{0};   // Changes when drawn apps (or icons) change
+
+    IconAtlas icons{[this]
+        {
+            ++view_generation;
+            if (running)
+                for_each_surface([this](auto& info) { this->draw_screen(info); });
+        }};
+
+    // Frames are drawn (and the grid hit tested) with outputs_mutex held
+    LauncherView mutable view{icons, readahead};
+
+    CatalogueWatcher watcher{[this](std::shared_ptr<Catalogue const> update)
+        {
+            std::vector<std::string> names;
+            names.reserve(update->size());
+            for (Catalogue::size_type i = 0; i != update->size(); ++i)
+                names.emplace_back((*update)[i].icon);
+            icons.icons(std::move(names));
+
+            std::atomic_store(&latest, std::move(update));
+            loaded = true;
+            if (running)
+                for_each_surface([this](auto& info) { this->draw_screen(info); });
+        }};
 };
 
 egmde::Launcher::Launcher(miral::ExternalClientLauncher& external_client_launcher, std::string terminal_cmd) :
     external_client_launcher{external_client_launcher},
-    terminal_cmd{std::move(terminal_cmd)}
+    terminal_cmd{std::move(terminal_cmd)},
+    startup{[this](std::string const& app) { return run_app(app, Mode::wayland); }}
 {
 }
 
 void egmde::Launcher::stop()
 {
+    startup.stop();
+
     if (auto ss = self.lock())
     {
         std::lock_guard<decltype(mutex)> lock{mutex};
@@ -549,7 +290,7 @@ void egmde::Launcher::show()
 
 void egmde::Launcher::operator()(wl_display* display)
 {
-    auto client = std::make_shared<Self>(display, external_client_launcher, terminal_cmd);
+    auto client = std::make_shared<Self>(display, external_client_launcher, terminal_cmd, launch_times);
     self = client;
     client->run(display);
 
@@ -560,18 +301,49 @@ void egmde::Launcher::operator()(wl_display* display)
 
 auto egmde::Launcher::run_app(std::string app, Mode mode) const -> pid_t
 {
-    return ::run_app(external_client_launcher, std::move(app), mode);
+    auto const pid = ::run_app(external_client_launcher, app, mode);
+    launch_times.launched(pid, app);
+    return pid;
+}
+
+auto egmde::Launcher::run_shell_component(std::string const& app) -> pid_t
+{
+    return startup.launch_now(app);
+}
+
+void egmde::Launcher::autostart_apps()
+{
+    do_autostart(startup);
+}
+
+void egmde::Launcher::advise_new_surface_for(pid_t pid)
+{
+    startup.advise_new_window_for(pid);
+}
+
+void egmde::Launcher::advise_new_window_for(pid_t pid)
+{
+    launch_times.advise_new_window_for(pid);
 }
 
-void egmde::Launcher::autostart_apps() const
+void egmde::Launcher::dump_launch_times() const
 {
-    do_autostart(external_client_launcher);
+    launch_times.dump();
 }
 
 void egmde::Launcher::Self::start()
 {
     if (!running.exchange(true))
     {
+        {
+            std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+            use_latest_catalogue();
+            reset_query();
+            query_typed = false;
+            order_by_use();
+            current_app = 0;
+            command.reset();
+        }
         showing = nullptr;
         for_each_surface([this](auto& info) { this->draw_screen(info);});
     }
@@ -581,25 +353,66 @@ void egmde::Launcher::Self::keyboard_key(wl_keyboard* /*keyboard*/, uint32_t /*s
 {
     if (state == WL_KEYBOARD_KEY_STATE_PRESSED)
     {
-        switch (auto const keysym = xkb_state_key_get_one_sym(keyboard_state(), key+8))
+        auto const keysym = xkb_state_key_get_one_sym(keyboard_state(), key+8);
+
+        if (command_key(keysym))
+            return;
+
+        switch (keysym)
         {
         case XKB_KEY_Right:
-        case XKB_KEY_Down:
             next_app();
             break;
 
         case XKB_KEY_Left:
-        case XKB_KEY_Up:
             prev_app();
             break;
 
+        case XKB_KEY_Down:
+            if (grid_view)
+                move_selection(view.grid_columns());
+            else
+                next_app();
+            break;
+
+        case XKB_KEY_Up:
+            if (grid_view)
+                move_selection(-view.grid_columns());
+            else
+                prev_app();
+            break;
+
+        case XKB_KEY_Page_Down:
+            move_selection(grid_view ? view.grid_page() : 1);
+            break;
+
+        case XKB_KEY_Page_Up:
+            move_selection(grid_view ? -view.grid_page() : -1);
+            break;
+
+        case XKB_KEY_F2:
+            toggle_grid();
+            break;
+
         case XKB_KEY_Return:
-        case XKB_KEY_space:
             run_app();
             break;
 
+        case XKB_KEY_space:
+            // Separates the words of a query (without one, runs the app)
+            if (!extend_query(" "))
+                run_app();
+            break;
+
         case XKB_KEY_BackSpace:
-            run_app(Mode::x11);
+            // Only runs the app (with X11) if nothing was typed: holding Backspace down to delete
+            // a query (or pressing it once too often) shouldn't launch anything
+            if (!shorten_query())
+                run_app(Mode::x11);
+            break;
+
+        case XKB_KEY_Tab:
+            start_command();
             break;
 
         case XKB_KEY_F11:
@@ -611,36 +424,20 @@ void egmde::Launcher::Self::keyboard_key(wl_keyboard* /*keyboard*/, uint32_t /*s
             break;
 
         case XKB_KEY_Escape:
-            running = false;
-            for_each_surface([this](auto& info) { this->draw_screen(info); });
+            if (!clear_query())
+            {
+                running = false;
+                for_each_surface([this](auto& info) { this->draw_screen(info); });
+            }
             break;
 
         default:
         {
-            uint32_t utf32 = xkb_keysym_to_utf32(keysym);
-
-            if (isalnum(utf32))
-            {
-                char const text[] = {static_cast<char>(toupper(utf32)), '\0'};
-
-                auto p = current_app + 1;
-                auto end = apps.end();
+            char text[8];
+            auto const length = xkb_keysym_to_utf8(keysym, text, sizeof text);
 
-                if (p == end || text < current_app->name.substr(0,1))
-                {
-                    p = apps.begin();
-                    end = current_app;
-                }
-
-                while (text > p->name.substr(0,1) && p != apps.end())
-                    ++p;
-
-                if (p != apps.end())
-                {
-                    current_app = p;
-                    for_each_surface([this](auto& info) { this->draw_screen(info); });
-                }
-            }
+            if (length > 1 && static_cast<unsigned char>(text[0]) > ' ' && text[0] != 0x7f)
+                extend_query({text, size_t(length - 1)});
         }
         }
     }
@@ -648,6 +445,7 @@ void egmde::Launcher::Self::keyboard_key(wl_keyboard* /*keyboard*/, uint32_t /*s
 
 void egmde::Launcher::Self::pointer_motion(wl_pointer* pointer, uint32_t time, wl_fixed_t x, wl_fixed_t y)
 {
+    pointer_x = wl_fixed_to_int(x);
     pointer_y = wl_fixed_to_int(y);
     FullscreenClient::pointer_motion(pointer, time, x, y);
 }
@@ -662,12 +460,15 @@ void egmde::Launcher::Self::pointer_button(
     if (BTN_LEFT == button &&
         WL_POINTER_BUTTON_STATE_PRESSED == state)
     {
-        if (pointer_y < height/3)
-            prev_app();
-        else if (pointer_y > (2*height)/3)
-            next_app();
-        else
-            run_app();
+        if (!grid_click(pointer_surface, pointer_x, pointer_y, false))
+        {
+            if (pointer_y < height/3)
+                prev_app();
+            else if (pointer_y > (2*height)/3)
+                next_app();
+            else
+                run_app();
+        }
     }
 
     FullscreenClient::pointer_button(pointer, serial, time, button, state);
@@ -680,6 +481,8 @@ void egmde::Launcher::Self::pointer_enter(
     wl_fixed_t x,
     wl_fixed_t y)
 {
+    pointer_surface = surface;
+    pointer_x = wl_fixed_to_int(x);
     pointer_y = wl_fixed_to_int(y);
 
     for_each_surface([&, this](SurfaceInfo& info)
@@ -694,6 +497,7 @@ void egmde::Launcher::Self::pointer_enter(
 void egmde::Launcher::Self::touch_down(
     wl_touch* touch, uint32_t serial, uint32_t time, wl_surface* surface, int32_t id, wl_fixed_t x, wl_fixed_t y)
 {
+    auto const touch_x = wl_fixed_to_int(x);
     auto const touch_y = wl_fixed_to_int(y);
     int height = -1;
 
@@ -703,7 +507,7 @@ void egmde::Launcher::Self::touch_down(
                 height = info.output->height;
          });
 
-    if (height >= 0)
+    if (!grid_click(surface, touch_x, touch_y, true) && height >= 0)
     {
         if (touch_y < height/3)
             prev_app();
@@ -718,16 +522,51 @@ void egmde::Launcher::Self::touch_down(
 
 void egmde::Launcher::Self::run_app(Mode mode)
 {
-    if (getenv("EGMDE_SNAP_LAUNCH") &&
-        current_app->desktop_dir == "/var/lib/snapd/desktop/applications")
+    std::optional<std::string> command_line;
+
+    // Keep the catalogue (which owns the app's details) while launching
+    std::shared_ptr<Catalogue const> launching;
+    Catalogue::size_type index = 0;
+
     {
-        external_client_launcher.snapcraft_launch(current_app->desktop_file);
+        std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+        use_latest_catalogue();
+
+        if (command)
+        {
+            command_line = std::move(command);
+            command.reset();
+        }
+        else if (current_app < visible_size())
+        {
+            launching = apps;
+            index = visible_index(current_app);
+            usage.record(apps->key(index));
+        }
+    }
+
+    if (command_line)
+    {
+        if (!command_line->empty())
+            launch_times.launched(::run_app(external_client_launcher, *command_line, mode), *command_line);
+    }
+    else if (!launching)
+    {
+        // Nothing to run
+    }
+    else if (auto const app = (*launching)[index];
+        getenv("EGMDE_SNAP_LAUNCH") && app.desktop_dir == "/var/lib/snapd/desktop/applications")
+    {
+        external_client_launcher.snapcraft_launch(std::string{app.desktop_file});
     }
     else
     {
-        auto app = current_app->terminal ? terminal_cmd + " -e " + current_app->exec : current_app->exec;
+        std::string const exec{app.exec};
+        auto command = app.terminal ? terminal_cmd + " -e " + exec : exec;
+
+        auto const program = app.terminal ? std::string{} : std::string{app.program};
 
-        ::run_app(external_client_launcher, app, mode);
+        launch_times.launched(::run_app(external_client_launcher, command, mode, program), std::string{app.name});
     }
 
     running = false;
@@ -736,26 +575,351 @@ void egmde::Launcher::Self::run_app(Mode mode)
 
 void egmde::Launcher::Self::next_app()
 {
-    if (++current_app == apps.end())
-        current_app = apps.begin();
+    {
+        std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+        use_latest_catalogue();
+
+        if (++current_app >= visible_size())
+            current_app = 0;
+    }
 
     for_each_surface([this](auto& info) { this->draw_screen(info); });
 }
 
+// Move the selection (stopping at the first and last apps)
+void egmde::Launcher::Self::move_selection(int delta)
+{
+    {
+        std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+        use_latest_catalogue();
+
+        if (auto const size = visible_size())
+        {
+            auto const target = std::clamp<int64_t>(int64_t{current_app} + delta, 0, size - 1);
+            current_app = static_cast<Catalogue::size_type>(target);
+        }
+    }
+
+    for_each_surface([this](auto& info) { this->draw_screen(info); });
+}
+
+void egmde::Launcher::Self::toggle_grid()
+{
+    grid_view = !grid_view;
+    ++view_generation;
+    for_each_surface([this](auto& info) { this->draw_screen(info); });
+}
+
+auto egmde::Launcher::Self::grid_click(wl_surface* surface, int x, int y, bool run_now) -> bool
+{
+    auto shown = false;
+    std::optional<Catalogue::size_type> position;
+
+    for_each_surface([&, this](SurfaceInfo& info)
+        {
+            if (!grid_view || surface != info.surface || !view.grid_shown(info.output))
+                return;
+
+            // The grid is laid out in buffer pixels, the point is in surface coordinates
+            shown = true;
+            auto const scale = info.output->scale_factor;
+            position = view.grid_position_at(info.output, x*scale, y*scale);
+        });
+
+    if (!position)
+        return shown;
+
+    {
+        std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+        use_latest_catalogue();
+
+        if (*position >= visible_size())
+            return true;
+
+        run_now = run_now || *position == current_app;
+        current_app = *position;
+    }
+
+    if (run_now)
+        run_app();
+    else
+        for_each_surface([this](auto& info) { this->draw_screen(info); });
+
+    return true;
+}
+
 void egmde::Launcher::Self::prev_app()
 {
-    if (current_app == apps.begin())
-        current_app = apps.end();
+    {
+        std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+        use_latest_catalogue();
+
+        if (current_app == 0)
+            current_app = visible_size();
+
+        if (current_app != 0)
+            --current_app;
+    }
+
+    for_each_surface([this](auto& info) { this->draw_screen(info); });
+}
+
+auto egmde::Launcher::Self::extend_query(std::string_view text) -> bool
+{
+    {
+        std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+        use_latest_catalogue();
+
+        // A query starts with a word
+        if (query.empty() && text == " ")
+            return false;
+
+        auto const* const previous = query.empty() ? nullptr : &narrowing.back();
+
+        Catalogue::append_lower(query, text);
+        query_typed = true;
+        ++view_generation;
+
+        auto matches = apps->search(query, previous);
+        narrowing.push_back(std::move(matches));
+        current_app = 0;
+    }
+
+    for_each_surface([this](auto& info) { this->draw_screen(info); });
+    return true;
+}
+
+auto egmde::Launcher::Self::shorten_query() -> bool
+{
+    {
+        std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+        use_latest_catalogue();
+
+        if (query.empty())
+            return query_typed;
+
+        // Remove the last (UTF-8) character and go back to the matches before it was typed
+        do query.pop_back(); while (!query.empty() && (query.back() & 0xc0) == 0x80);
+        narrowing.pop_back();
+        ++view_generation;
+
+        if (narrowing.empty() && !query.empty())
+            narrowing.push_back(apps->search(query));
+
+        current_app = 0;
+    }
+
+    for_each_surface([this](auto& info) { this->draw_screen(info); });
+    return true;
+}
+
+// Enter command mode (starting with anything typed as a search)
+void egmde::Launcher::Self::start_command()
+{
+    {
+        std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+        command = query;
+    }
+
+    for_each_surface([this](auto& info) { this->draw_screen(info); });
+}
+
+// In command mode keys edit (or complete) the command instead of choosing an app
+auto egmde::Launcher::Self::command_key(xkb_keysym_t keysym) -> bool
+{
+    auto launch = false;
+
+    {
+        std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+        use_latest_catalogue();
+
+        if (!command)
+            return false;
+
+        switch (keysym)
+        {
+        case XKB_KEY_Return:
+        case XKB_KEY_KP_Enter:
+            launch = true;
+            break;
+
+        case XKB_KEY_Tab:
+            // Only the program is completed
+            if (auto const commands = apps->commands(); commands && command->find(' ') == std::string::npos)
+            {
+                auto const completion = commands->complete(*command);
+                *command = completion.text;
+                if (completion.count() == 1)
+                    *command += ' ';
+            }
+            break;
 
-    --current_app;
+        case XKB_KEY_BackSpace:
+            if (command->empty())
+                command.reset();
+            else
+                do command->pop_back(); while (!command->empty() && (command->back() & 0xc0) == 0x80);
+            break;
+
+        case XKB_KEY_Escape:
+            command.reset();
+            break;
+
+        default:
+        {
+            char text[8];
+            auto const length = xkb_keysym_to_utf8(keysym, text, sizeof text);
+
+            if (length > 1 && static_cast<unsigned char>(text[0]) >= ' ' && text[0] != 0x7f)
+                command->append(text, length - 1);
+        }
+        }
+    }
+
+    if (launch)
+        run_app();
+    else
+        for_each_surface([this](auto& info) { this->draw_screen(info); });
+
+    return true;
+}
+
+auto egmde::Launcher::Self::clear_query() -> bool
+{
+    {
+        std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+        use_latest_catalogue();
+
+        if (query.empty())
+            return false;
+
+        reset_query();
+    }
 
     for_each_surface([this](auto& info) { this->draw_screen(info); });
+    return true;
 }
 
-egmde::Launcher::Self::Self(wl_display* display, ExternalClientLauncher& external_client_launcher, std::string terminal_cmd) :
+// Requires selection_mutex: the apps matching the query (or all of them)
+auto egmde::Launcher::Self::visible_size() const -> Catalogue::size_type
+{
+    return query.empty() ? ordered.size() : narrowing.back().size();
+}
+
+// Requires selection_mutex
+auto egmde::Launcher::Self::visible_index(Catalogue::size_type i) const -> Catalogue::size_type
+{
+    return query.empty() ? ordered[i] : narrowing.back()[i];
+}
+
+// Requires selection_mutex
+auto egmde::Launcher::Self::visible(Catalogue::size_type i) const -> Catalogue::Entry
+{
+    return (*apps)[visible_index(i)];
+}
+
+// Requires selection_mutex: drop the query, keeping the selected app
+void egmde::Launcher::Self::reset_query() const
+{
+    if (query.empty())
+        return;
+
+    ++view_generation;
+
+    std::optional<uint64_t> selected;
+    if (current_app < visible_size())
+        selected = apps->key(visible_index(current_app));
+
+    query.clear();
+    narrowing.clear();
+
+    if (selected)
+        select(*selected);
+}
+
+// Requires selection_mutex: order the apps by use, and then by title
+void egmde::Launcher::Self::order_by_use() const
+{
+    ++view_generation;
+
+    std::vector<std::pair<double, uint32_t>> used;
+    usage.for_each([&](uint64_t key, double score)
+        {
+            if (auto const app = apps->find(key))
+                used.emplace_back(score, *app);
+        });
+
+    std::sort(begin(used), end(used), [](auto const& lhs, auto const& rhs)
+        { return lhs.first > rhs.first || (lhs.first == rhs.first && lhs.second < rhs.second); });
+
+    std::vector<bool> placed(apps->size());
+    ordered.clear();
+    ordered.reserve(apps->size());
+
+    for (auto const& app : used)
+    {
+        ordered.push_back(app.second);
+        placed[app.second] = true;
+    }
+
+    for (uint32_t app = 0; app != apps->size(); ++app)
+    {
+        if (!placed[app])
+            ordered.push_back(app);
+    }
+}
+
+// Requires selection_mutex: select app if it is visible (otherwise the first app)
+void egmde::Launcher::Self::select(uint64_t usage_key) const
+{
+    current_app = 0;
+
+    auto const app = apps->find(usage_key);
+    if (!app)
+        return;
+
+    for (Catalogue::size_type i = 0; i != visible_size(); ++i)
+    {
+        if (visible_index(i) == *app)
+        {
+            current_app = i;
+            break;
+        }
+    }
+}
+
+// Requires selection_mutex: switch to the latest catalogue, keeping the selected app if it is still there
+void egmde::Launcher::Self::use_latest_catalogue() const
+{
+    auto const update = std::atomic_load(&latest);
+
+    if (update == apps)
+        return;
+
+    auto const previous = apps;
+    std::optional<uint64_t> selected;
+    if (previous && current_app < visible_size())
+        selected = previous->key(visible_index(current_app));
+
+    apps = update;
+    order_by_use();
+    narrowing.clear();
+    if (!query.empty())
+        narrowing.push_back(apps->search(query));
+
+    current_app = 0;
+
+    if (selected)
+        select(*selected);
+}
+
+egmde::Launcher::Self::Self(
+    wl_display* display, ExternalClientLauncher& external_client_launcher, std::string terminal_cmd,
+    LaunchTimes& launch_times) :
     FullscreenClient{display},
     external_client_launcher{external_client_launcher},
-    terminal_cmd{std::move(terminal_cmd)}
+    terminal_cmd{std::move(terminal_cmd)},
+    launch_times{launch_times}
 {
     wl_display_roundtrip(display);
     wl_display_roundtrip(display);
@@ -798,14 +962,18 @@ void egmde::Launcher::Self::show_screen(SurfaceInfo& info) const
         info.surface = wl_compositor_create_surface(compositor);
     }
 
-    if (!info.shell_surface)
+    if (!info.shell_surface || info.standby)
     {
-        info.shell_surface = wl_shell_get_shell_surface(shell, info.surface);
+        if (!info.shell_surface)
+            info.shell_surface = wl_shell_get_shell_surface(shell, info.surface);
+
         wl_shell_surface_set_fullscreen(
             info.shell_surface,
             WL_SHELL_SURFACE_FULLSCREEN_METHOD_DEFAULT,
             0,
             info.output->output);
+
+        info.standby = false;
     }
 
     if (!info.buffer)
@@ -817,39 +985,41 @@ void egmde::Launcher::Self::show_screen(SurfaceInfo& info) const
             WL_SHM_FORMAT_ARGB8888);
     }
 
-    static uint8_t const pattern[4] = {0x1f, 0x1f, 0x1f, 0xaf};
-
-    auto const content_area = reinterpret_cast<unsigned char*>(info.content_area);
-    auto row = content_area;
+    LauncherView::Target const target{info.output, static_cast<unsigned char*>(info.content_area), width, height};
 
-    for (int j = 0; j != height; ++j)
     {
-        for (int i = 0; i < width; i++)
-            memcpy(row + 4 * i, pattern, 4);
-        row += stride;
-    }
+        std::lock_guard<decltype(selection_mutex)> lock{selection_mutex};
+        use_latest_catalogue();
 
-    // One day we'll use the icon file
-
-    auto const prev = (current_app == apps.begin() ? apps.end() : current_app) - 1;
-    auto const next = current_app == apps.end()-1 ? apps.begin() : current_app + 1;
+        view.prepare(target, {apps, query.empty() ? &ordered : &narrowing.back(), current_app, query,
+            command ? &*command : nullptr, loaded, grid_view, view_generation});
+    }
 
-    static Printer printer;
-    printer.print(width, height, content_area, {prev->title,  current_app->title, next->title});
-    auto const help =
-        "<Enter> = start app | "
-        "<BkSp> = start using X11 | "
-        "Arrows (or initial letter) = change app | <Esc> = cancel";
-    printer.footer(width, height, content_area, {help, "", ""});
+    view.draw();
 
     wl_surface_attach(info.surface, info.buffer, 0, 0);
     wl_surface_set_buffer_scale(info.surface, info.output->scale_factor);
     wl_surface_commit(info.surface);
 }
 
-void egmde::Launcher::Self::clear_screen(SurfaceInfo& info)
+// Unmap the surface, but keep it (and its buffer) for a while: showing it again is then just a commit
+void egmde::Launcher::Self::clear_screen(SurfaceInfo& info) const
 {
-    info.clear_window();
+    readahead.anticipate("");
+
+    if (!info.surface || info.standby)
+        return;
+
+    wl_surface_attach(info.surface, nullptr, 0, 0);
+    wl_surface_commit(info.surface);
+    info.standby = true;
+
+    auto const generation = ++standby_generation;
+    call_after(standby_timeout, [this, generation]
+        {
+            if (!running && generation == standby_generation)
+                for_each_surface([](auto& info) { if (info.standby) info.clear_window(); });
+        });
 }
 
 void egmde::Launcher::Self::keyboard_leave(wl_keyboard* /*keyboard*/, uint32_t /*serial*/, wl_surface* /*surface*/)
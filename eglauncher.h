@@ -19,6 +19,9 @@
 #ifndef EGMDE_LAUNCHER_H
 #define EGMDE_LAUNCHER_H
 
+#include "eglaunchtimes.h"
+#include "egstartup.h"
+
 #include <miral/application.h>
 
 #include <miral/external_client.h>
@@ -55,13 +58,24 @@ public:
         return weak_session.lock();
     }
 
-    void autostart_apps() const;
+    // Shell components and autostart apps are started by a StartupScheduler
+    auto run_shell_component(std::string const& app) -> pid_t;
+    void autostart_apps();
+    void advise_new_surface_for(pid_t pid);     // On any layer (e.g. panels)
+
+    // An application window: the first for a launched app ends the launch time
+    void advise_new_window_for(pid_t pid);
+
+    // Logs the time taken by launched apps to show their first window
+    void dump_launch_times() const;
 
 private:
     miral::ExternalClientLauncher& external_client_launcher;
     std::mutex mutable mutex;
     std::weak_ptr<mir::scene::Session> weak_session;
     std::string const terminal_cmd;
+    LaunchTimes mutable launch_times;
+    StartupScheduler startup;
 
     struct Self;
     std::weak_ptr<Self> self;
@@ -0,0 +1,445 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+
+#include "eglauncherview.h"
+#include "egcommandtrie.h"
+#include "egiconatlas.h"
+#include "egreadahead.h"
+#include "printer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <vector>
+
+namespace
+{
+uint8_t const background[4] = {0x1f, 0x1f, 0x1f, 0xaf};
+uint8_t const highlight[4] = {0x4f, 0x4f, 0x4f, 0xcf};
+
+char const* const app_help = "<Enter> = start app | <BkSp> = start using X11 | Arrows = change app | <F2> = grid or list";
+char const* const app_help_more = "Type to search | <Tab> = run a command | <Esc> = cancel";
+char const* const command_help = "<Enter> = run command | <Tab> = complete | <Esc> = back to apps";
+
+size_t const shown_completions = 8;
+
+void fill(unsigned char* region_address, int32_t stride, int x, int y, int width, int height, uint8_t const (&colour)[4])
+{
+    auto const first_row = region_address + y*stride + 4*x;
+
+    for (int i = 0; i != width; ++i)
+        memcpy(first_row + 4*i, colour, 4);
+
+    for (int j = 1; j < height; ++j)
+        memcpy(first_row + j*stride, first_row, 4*width);
+}
+
+// The arrangement of the launcher's grid view on an output (leaving room for the footer)
+struct grid_layout
+{
+    grid_layout(int32_t width, int32_t height) :
+        icon_size{height >= 1200 ? 64 : 48},
+        text_size{icon_size/3},
+        cell_width{3*icon_size},
+        cell_height{icon_size + 2*text_size + icon_size/4},
+        columns{std::max(1, width/cell_width)},
+        rows{std::max(1, (height - height/16 - std::max(height/8, 5*(width/60)))/cell_height)},
+        left{(width - columns*cell_width)/2},
+        top{height/16}
+    {
+    }
+
+    auto x(int column) const -> int { return left + column*cell_width; }
+    auto y(int row) const -> int { return top + row*cell_height; }
+
+    int const icon_size;
+    int const text_size;
+    int const cell_width;
+    int const cell_height;
+    int const columns;
+    int const rows;
+    int const left;
+    int const top;
+};
+
+struct grid_cell
+{
+    int row;
+    int column;
+    bool selected;
+    bool present;
+    std::string_view title;
+    std::string_view icon;
+};
+}
+
+struct egmde::LauncherView::Self
+{
+    Self(IconAtlas& icons, Readahead& readahead) :
+        icons{icons},
+        readahead{readahead}
+    {
+    }
+
+    auto visible(Selection const& selection, Catalogue::size_type i) const -> Catalogue::Entry
+    {
+        return (*apps)[(*selection.visible)[i]];
+    }
+
+    auto prepare_grid(Selection const& selection) -> bool;
+    void prepare_list(Selection const& selection);
+    void draw_grid();
+    void draw_cell(grid_layout const& layout, grid_cell const& cell);
+    void draw_list();
+
+    IconAtlas& icons;
+    Readahead& readahead;
+    Printer printer;
+
+    std::atomic<int> grid_columns{1};
+    std::atomic<int> grid_page{1};
+
+    // The grid view remembers what it last drew on each output so that moving the selection
+    // redraws two cells, and scrolling moves the rows still visible
+    struct GridFrame
+    {
+        unsigned char* content_area = nullptr;  // Null when something else has been drawn since
+        int32_t width = 0;
+        int32_t height = 0;
+        unsigned generation = 0;
+        int first_row = 0;
+        Catalogue::size_type selected = 0;
+    };
+
+    std::map<void const*, GridFrame> grid_frames;
+
+    // The frame being drawn. The text isn't copied: it is viewed in the catalogue (kept here)
+    // or in buffers reused for each frame
+    Target target{};
+    std::shared_ptr<Catalogue const> apps;
+    bool grid = false;
+    std::string_view current_program;
+    std::string_view search;
+
+    // The list view
+    std::string_view prev_title;
+    std::string_view current_title;
+    std::string_view next_title;
+    std::string_view current_icon;
+    size_t title_width = 1;
+    bool command_mode = false;
+
+    // The grid view
+    bool redraw_all = false;
+    int shift = 0;      // Rows scrolled since the last frame
+    std::vector<grid_cell> cells;
+
+    std::string search_text;
+    std::string command_text;
+    std::string completions_text;
+};
+
+egmde::LauncherView::LauncherView(IconAtlas& icons, Readahead& readahead) :
+    self{std::make_unique<Self>(icons, readahead)}
+{
+}
+
+egmde::LauncherView::~LauncherView() = default;
+
+void egmde::LauncherView::prepare(Target const& target, Selection const& selection)
+{
+    self->target = target;
+    self->apps = selection.apps;
+    self->current_program = {};
+    self->search = {};
+    self->grid = selection.grid && self->prepare_grid(selection);
+
+    if (!self->grid)
+    {
+        // Drawing anything else replaces the grid
+        auto const frame = self->grid_frames.find(target.output);
+        if (frame != self->grid_frames.end())
+            frame->second.content_area = nullptr;
+
+        self->prepare_list(selection);
+    }
+}
+
+void egmde::LauncherView::draw()
+{
+    self->readahead.anticipate(self->current_program);
+
+    if (self->grid)
+        self->draw_grid();
+    else
+        self->draw_list();
+
+    self->apps.reset();
+}
+
+auto egmde::LauncherView::grid_columns() const -> int
+{
+    return self->grid_columns;
+}
+
+auto egmde::LauncherView::grid_page() const -> int
+{
+    return self->grid_page;
+}
+
+auto egmde::LauncherView::grid_shown(void const* output) const -> bool
+{
+    auto const frame = self->grid_frames.find(output);
+    return frame != self->grid_frames.end() && frame->second.content_area;
+}
+
+auto egmde::LauncherView::grid_position_at(void const* output, int x, int y) const -> std::optional<Catalogue::size_type>
+{
+    if (!grid_shown(output))
+        return std::nullopt;
+
+    auto const& frame = self->grid_frames.find(output)->second;
+    grid_layout const layout{frame.width, frame.height};
+
+    if (x < layout.left || y < layout.top)
+        return std::nullopt;
+
+    auto const column = (x - layout.left)/layout.cell_width;
+    auto const row = (y - layout.top)/layout.cell_height;
+
+    if (column >= layout.columns || row >= layout.rows)
+        return std::nullopt;
+
+    return static_cast<Catalogue::size_type>((frame.first_row + row)*layout.columns + column);
+}
+
+// A screenful of the visible apps as a grid (returns false if there are none)
+auto egmde::LauncherView::Self::prepare_grid(Selection const& selection) -> bool
+{
+    auto const size = static_cast<Catalogue::size_type>(selection.visible->size());
+    if (selection.command || !size)
+        return false;
+
+    grid_layout const layout{target.width, target.height};
+    grid_columns = layout.columns;
+    grid_page = layout.columns*layout.rows;
+
+    auto& frame = grid_frames[target.output];
+    auto const current = selection.current;
+
+    cells.clear();
+    redraw_all = frame.content_area != target.pixels || frame.width != target.width ||
+        frame.height != target.height || frame.generation != selection.generation;
+
+    // Scroll as little as will keep the selection visible
+    auto const selected_row = static_cast<int>(current/layout.columns);
+    auto first_row = redraw_all ? 0 : frame.first_row;
+    first_row = std::min(first_row, selected_row);
+    first_row = std::max(first_row, selected_row - layout.rows + 1);
+
+    shift = redraw_all ? 0 : first_row - frame.first_row;
+    if (std::abs(shift) >= layout.rows)
+        redraw_all = true;
+
+    auto const exposed = [&](int row)
+        { return redraw_all || (shift > 0 && row >= layout.rows - shift) || (shift < 0 && row < -shift); };
+
+    auto const add_cell = [&](int row, int column)
+        {
+            auto const position = static_cast<Catalogue::size_type>((first_row + row)*layout.columns + column);
+            grid_cell cell{row, column, position == current, position < size, {}, {}};
+            if (cell.present)
+            {
+                auto const app = visible(selection, position);
+                cell.title = app.title;
+                cell.icon = app.icon;
+            }
+            cells.push_back(cell);
+        };
+
+    // Only the rows scrolled into view need drawing...
+    for (auto row = 0; row != layout.rows; ++row)
+    {
+        if (exposed(row))
+        {
+            for (auto column = 0; column != layout.columns; ++column)
+                add_cell(row, column);
+        }
+    }
+
+    // ...and the cells that were, or are now, selected
+    if (frame.selected != current)
+    {
+        for (auto const position : {frame.selected, current})
+        {
+            auto const row = static_cast<int>(position/layout.columns) - first_row;
+            if (0 <= row && row < layout.rows && !exposed(row))
+                add_cell(row, position % layout.columns);
+        }
+    }
+
+    current_program = visible(selection, current).program;
+    if (!selection.query.empty())
+        search = search_text.assign("Search: ").append(selection.query);
+
+    frame = GridFrame{target.pixels, target.width, target.height, selection.generation, first_row, current};
+    return true;
+}
+
+void egmde::LauncherView::Self::draw_grid()
+{
+    auto const width = target.width;
+    auto const height = target.height;
+    auto const stride = 4*width;
+    auto const content_area = target.pixels;
+    grid_layout const layout{width, height};
+
+    auto const rows_moved = layout.rows - std::abs(shift);
+    if (redraw_all)
+        fill(content_area, stride, 0, 0, width, height, background);
+    else if (shift > 0)
+        memmove(content_area + layout.y(0)*stride, content_area + layout.y(shift)*stride, rows_moved*layout.cell_height*stride);
+    else if (shift < 0)
+        memmove(content_area + layout.y(-shift)*stride, content_area + layout.y(0)*stride, rows_moved*layout.cell_height*stride);
+
+    for (auto const& cell : cells)
+        draw_cell(layout, cell);
+
+    if (redraw_all)
+        printer.footer(width, height, content_area, {app_help, app_help_more, search});
+}
+
+void egmde::LauncherView::Self::draw_cell(grid_layout const& layout, grid_cell const& cell)
+{
+    auto const width = target.width;
+    auto const height = target.height;
+    auto const content_area = target.pixels;
+    auto const x = layout.x(cell.column);
+    auto const y = layout.y(cell.row);
+
+    fill(content_area, 4*width, x, y, layout.cell_width, layout.cell_height, cell.selected ? highlight : background);
+
+    if (!cell.present)
+        return;
+
+    auto const icon_y = y + layout.icon_size/8;
+    if (!cell.icon.empty())
+        icons.draw(cell.icon, layout.icon_size, width, height, content_area, x + (layout.cell_width - layout.icon_size)/2, icon_y);
+
+    auto const baseline = icon_y + layout.icon_size + (3*layout.text_size)/2;
+    printer.label(width, height, content_area, x + layout.text_size/2, baseline, layout.cell_width - layout.text_size, cell.title, layout.text_size);
+}
+
+// The previous, current and next apps (or a message, or the command being typed)
+void egmde::LauncherView::Self::prepare_list(Selection const& selection)
+{
+    prev_title = {};
+    current_title = {};
+    next_title = {};
+    current_icon = {};
+    title_width = 1;
+    command_mode = selection.command != nullptr;
+
+    auto const size = static_cast<Catalogue::size_type>(selection.visible->size());
+
+    if (command_mode)
+    {
+        auto const& command = *selection.command;
+        current_title = command_text.assign("Run: ").append(command);
+
+        // The executables the program could be completed to
+        completions_text.clear();
+        if (auto const commands = apps->commands();
+            commands && !command.empty() && command.find(' ') == std::string::npos)
+        {
+            auto const completion = commands->complete(command);
+            auto const shown_end = completion.begin + std::min<uint32_t>(completion.count(), shown_completions);
+
+            for (auto i = completion.begin; i != shown_end; ++i)
+            {
+                if (!completions_text.empty())
+                    completions_text += "  ";
+                completions_text += commands->name(i);
+            }
+
+            if (shown_end != completion.end)
+            {
+                char more[16];
+                auto const end = std::to_chars(std::begin(more), std::end(more), completion.end - shown_end).ptr;
+                completions_text.append("  (+").append(more, end).append(")");
+            }
+        }
+        next_title = completions_text;
+    }
+    else if (size)
+    {
+        auto const current = selection.current;
+        auto const prev = (current == 0 ? size : current) - 1;
+        auto const next = current == size-1 ? 0 : current + 1;
+
+        // Titles are sized as if as long as the longest (so the size doesn't change as they do)
+        title_width = apps->title_width();
+        prev_title = visible(selection, prev).title;
+        current_title = visible(selection, current).title;
+        current_icon = visible(selection, current).icon;
+        current_program = visible(selection, current).program;
+        next_title = visible(selection, next).title;
+    }
+    else if (!selection.query.empty())
+    {
+        current_title = "No matching applications";
+    }
+    else
+    {
+        current_title = selection.loaded ? "No applications found" : "Loading applications...";
+    }
+
+    if (!selection.query.empty() && !command_mode)
+        search = search_text.assign("Search: ").append(selection.query);
+}
+
+void egmde::LauncherView::Self::draw_list()
+{
+    auto const width = target.width;
+    auto const height = target.height;
+    auto const content_area = target.pixels;
+
+    fill(content_area, 4*width, 0, 0, width, height, background);
+
+    // The icon goes above the current app's title (which is in the middle of the screen)
+    if (!current_icon.empty())
+    {
+        static int const icon_sizes[] = {256, 192, 128, 96, 64, 48, 32, 24, 16};
+        auto const size = *std::find_if(std::begin(icon_sizes), std::end(icon_sizes) - 1,
+            [&](int size) { return size <= height/8; });
+
+        icons.draw(current_icon, size, width, height, content_area, (width - size)/2, height/2 - size - height/16);
+    }
+
+    printer.print(width, height, content_area, {prev_title, current_title, next_title}, title_width);
+
+    if (command_mode)
+        printer.footer(width, height, content_area, {command_help, "", ""});
+    else
+        printer.footer(width, height, content_area, {app_help, app_help_more, search});
+}
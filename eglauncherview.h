@@ -0,0 +1,89 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+
+#ifndef EGMDE_EGLAUNCHERVIEW_H
+#define EGMDE_EGLAUNCHERVIEW_H
+
+#include "egcatalogue.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace egmde
+{
+class IconAtlas;
+class Readahead;
+
+// Draws the launcher's frames: the list view (the previous, current and next apps, or the command
+// being typed) or the grid view. Once the caches and buffers are warm, drawing doesn't allocate.
+// Frames are drawn one at a time (prepare() then draw()), from any thread.
+class LauncherView
+{
+public:
+    // What the launcher shows (valid while its selection is locked)
+    struct Selection
+    {
+        std::shared_ptr<Catalogue const> apps;
+        Catalogue::Matches const* visible;  // The apps shown (indices into apps), in order
+        Catalogue::size_type current;       // The selected app (index into visible)
+        std::string_view query;
+        std::string const* command;         // Being typed (null unless in command mode)
+        bool loaded;                        // The apps have been loaded
+        bool grid;                          // The grid view is wanted
+        unsigned generation;                // Changes when the apps shown (or their icons) change
+    };
+
+    // An ARGB8888 buffer for an output (which is only used to tell outputs apart)
+    struct Target
+    {
+        void const* output;
+        unsigned char* pixels;
+        int32_t width;
+        int32_t height;
+    };
+
+    LauncherView(IconAtlas& icons, Readahead& readahead);
+    ~LauncherView();
+
+    LauncherView(LauncherView const&) = delete;
+    LauncherView& operator=(LauncherView const&) = delete;
+
+    // Gathers what the frame shows (with the selection locked)...
+    void prepare(Target const& target, Selection const& selection);
+    // ...and then draws it (without the lock)
+    void draw();
+
+    // The grid's size, for moving the selection by a row or a page
+    auto grid_columns() const -> int;
+    auto grid_page() const -> int;
+
+    // Whether the grid was last drawn on an output, and the position of the app drawn at a point
+    // there (in buffer pixels). Only call between frames.
+    auto grid_shown(void const* output) const -> bool;
+    auto grid_position_at(void const* output, int x, int y) const -> std::optional<Catalogue::size_type>;
+
+private:
+    struct Self;
+    std::unique_ptr<Self> const self;
+};
+}
+
+#endif //EGMDE_EGLAUNCHERVIEW_H
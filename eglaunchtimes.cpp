@@ -0,0 +1,193 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "eglaunchtimes.h"
+
+#include <mir/log.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// Apps that haven't shown a window after this long are counted as windowless
+auto const window_timeout = 60s;
+
+// Bucket 0 is <1ms, bucket i is [2^(i-1), 2^i) ms and the last bucket is everything longer
+auto const bucket_count = 17u;
+
+auto bucket_for(unsigned long long ms) -> unsigned
+{
+    unsigned bucket = 0;
+    for (; ms && bucket != bucket_count-1; ms >>= 1)
+        ++bucket;
+    return bucket;
+}
+
+auto bucket_label(unsigned bucket) -> std::string
+{
+    if (bucket == 0)
+        return "<1ms";
+    if (bucket == bucket_count-1)
+        return ">=" + std::to_string(1ull << (bucket-1)) + "ms";
+    return std::to_string(1ull << (bucket-1)) + "-" + std::to_string(1ull << bucket) + "ms";
+}
+
+struct Histogram
+{
+    std::array<unsigned, bucket_count> buckets{};
+    unsigned windows = 0;
+    unsigned windowless = 0;
+    unsigned long long min_ms = ~0ull;
+    unsigned long long max_ms = 0;
+    unsigned long long total_ms = 0;
+
+    void add(unsigned long long ms)
+    {
+        ++buckets[bucket_for(ms)];
+        ++windows;
+        min_ms = std::min(min_ms, ms);
+        max_ms = std::max(max_ms, ms);
+        total_ms += ms;
+    }
+
+    // The upper bound of the bucket containing the given fraction of the launches
+    auto percentile(double fraction) const -> std::string
+    {
+        auto const target = std::max(1u, static_cast<unsigned>(fraction*windows + 0.5));
+        unsigned seen = 0;
+        for (auto bucket = 0u; bucket != bucket_count; ++bucket)
+        {
+            if ((seen += buckets[bucket]) >= target)
+            {
+                return bucket == bucket_count-1 ?
+                    bucket_label(bucket) : "<" + std::to_string(1ull << bucket) + "ms";
+            }
+        }
+        return "-";
+    }
+};
+
+struct Launch
+{
+    std::string app;
+    Clock::time_point time;
+};
+}
+
+struct egmde::LaunchTimes::Self
+{
+    void expire(Clock::time_point now);
+
+    std::mutex mutable mutex;
+    std::unordered_map<pid_t, Launch> pending;
+    std::map<std::string, Histogram> histograms;
+};
+
+egmde::LaunchTimes::LaunchTimes() :
+    self{std::make_unique<Self>()}
+{
+}
+
+egmde::LaunchTimes::~LaunchTimes() = default;
+
+void egmde::LaunchTimes::launched(pid_t pid, std::string const& app)
+{
+    if (pid <= 0)
+        return;
+
+    auto const now = Clock::now();
+
+    std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+    self->expire(now);
+    self->pending[pid] = Launch{app, now};
+}
+
+void egmde::LaunchTimes::advise_new_window_for(pid_t pid)
+{
+    auto const now = Clock::now();
+
+    std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+
+    // Only the first window after a launch counts
+    auto const launch = self->pending.find(pid);
+    if (launch == end(self->pending))
+        return;
+
+    auto const ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - launch->second.time).count();
+    self->histograms[launch->second.app].add(ms);
+    self->pending.erase(launch);
+}
+
+void egmde::LaunchTimes::dump() const
+{
+    std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+    self->expire(Clock::now());
+
+    mir::log_info("Launch to first window times (%zu app(s), %zu awaiting a window):",
+        self->histograms.size(), self->pending.size());
+
+    for (auto const& [app, histogram] : self->histograms)
+    {
+        if (!histogram.windows)
+        {
+            mir::log_info("  '%s': %u launch(es), none with a window", app.c_str(), histogram.windowless);
+            continue;
+        }
+
+        mir::log_info("  '%s': %u launch(es), %u without a window, min %llums, mean %llums, max %llums, p50 %s, p90 %s",
+            app.c_str(), histogram.windows + histogram.windowless, histogram.windowless,
+            histogram.min_ms, histogram.total_ms/histogram.windows, histogram.max_ms,
+            histogram.percentile(0.5).c_str(), histogram.percentile(0.9).c_str());
+
+        std::string buckets;
+        for (auto bucket = 0u; bucket != bucket_count; ++bucket)
+        {
+            if (histogram.buckets[bucket])
+            {
+                if (!buckets.empty()) buckets += " | ";
+                buckets += bucket_label(bucket) + ": " + std::to_string(histogram.buckets[bucket]);
+            }
+        }
+        mir::log_info("    %s", buckets.c_str());
+    }
+}
+
+void egmde::LaunchTimes::Self::expire(Clock::time_point now)
+{
+    for (auto i = begin(pending); i != end(pending); )
+    {
+        if (now - i->second.time > window_timeout)
+        {
+            ++histograms[i->second.app].windowless;
+            i = pending.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
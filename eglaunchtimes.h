@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGLAUNCHTIMES_H
+#define EGMDE_EGLAUNCHTIMES_H
+
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+
+namespace egmde
+{
+// Measures the time from launching an app to its first window, and keeps a histogram per app
+class LaunchTimes
+{
+public:
+    LaunchTimes();
+    ~LaunchTimes();
+
+    void launched(pid_t pid, std::string const& app);
+    void advise_new_window_for(pid_t pid);
+
+    // Logs the histograms
+    void dump() const;
+
+private:
+    struct Self;
+    std::unique_ptr<Self> const self;
+};
+}
+
+#endif //EGMDE_EGLAUNCHTIMES_H
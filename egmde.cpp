@@ -20,6 +20,7 @@
 #include "egwindowmanager.h"
 #include "egshellcommands.h"
 #include "eglauncher.h"
+#include "egfontservice.h"
 
 #include <miral/append_event_filter.h>
 #include <miral/command_line_option.h>
@@ -46,6 +47,9 @@ int main(int argc, char const* argv[])
 
     MirRunner runner{argc, argv};
 
+    // Load the font while the server starts, rather than when text is first drawn
+    egmde::FontService::instance().preload();
+
     egmde::Wallpaper wallpaper;
 
     ExternalClientLauncher external_client_launcher;
@@ -59,7 +63,7 @@ int main(int argc, char const* argv[])
         for (auto i = begin(apps); i != end(apps); )
         {
             auto const j = find(i, end(apps), ':');
-            shell_component_pids.insert(launcher.run_app(std::string{i, j}, egmde::Launcher::Mode::wayland));
+            shell_component_pids.insert(launcher.run_shell_component(std::string{i, j}));
             if ((i = j) != end(apps)) ++i;
         }
     };
@@ -106,6 +110,7 @@ int main(int argc, char const* argv[])
     };
     egmde::ShellCommands commands{runner, launcher, terminal_cmd, launch_app};
 
+    runner.register_signal_handler({SIGUSR1}, [&](int) { launcher.dump_launch_times(); });
     runner.add_stop_callback([&] { for (auto const pid : shell_component_pids) kill(pid, SIGTERM); });
     runner.add_stop_callback([&] { wallpaper.stop(); });
     runner.add_stop_callback([&] { launcher.stop(); });
@@ -126,6 +131,10 @@ int main(int argc, char const* argv[])
                               "wallpaper-top",    "Colour of wallpaper RGB", "0x000000"},
             CommandLineOption{[&](auto& option) { wallpaper.bottom(option);},
                               "wallpaper-bottom", "Colour of wallpaper RGB", EGMDE_WALLPAPER_BOTTOM},
+            CommandLineOption{[&](bool animate) { wallpaper.animate(animate);},
+                              "wallpaper-animate", "Drift the wallpaper colours with the time of day"},
+            CommandLineOption{[&](int budget) { wallpaper.cpu_budget(budget);},
+                              "wallpaper-cpu-budget", "CPU time (ms per minute) to spend animating the wallpaper", 100},
             pre_init(CommandLineOption{update_workspaces,
                               "no-of-workspaces", "Number of workspaces [1..32]", no_of_workspaces}),
             external_client_launcher,
@@ -0,0 +1,51 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGPARALLEL_H
+#define EGMDE_EGPARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace egmde
+{
+// Runs f(0)...f(count-1) on a bounded number of threads
+template<typename Function>
+void parallel_for(size_t count, Function const& f)
+{
+    static auto const max_workers = std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+    auto const workers = std::min<size_t>(max_workers, count);
+
+    std::atomic<size_t> next{0};
+    auto const work = [&] { for (size_t i; (i = next++) < count;) f(i); };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; ++i)
+        threads.emplace_back(work);
+
+    work();
+
+    for (auto& thread : threads)
+        thread.join();
+}
+}
+
+#endif //EGMDE_EGPARALLEL_H
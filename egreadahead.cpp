@@ -0,0 +1,441 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "egreadahead.h"
+
+#include <mir/log.h>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <link.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+// How long a selection must be kept before reading starts
+auto const dwell = 400ms;
+
+// Throttling: read in chunks, no faster than this, and no more than this for one app
+off_t const chunk_size = 1 << 20;
+double const max_bytes_per_second = 64 << 20;
+off_t const max_bytes_per_app = off_t{512} << 20;
+size_t const max_files_per_app = 256;
+
+auto split(std::string const& list, char separator) -> std::vector<std::string>
+{
+    std::vector<std::string> result;
+    std::istringstream in{list};
+
+    for (std::string item; std::getline(in, item, separator);)
+    {
+        if (!item.empty())
+            result.push_back(item);
+    }
+
+    return result;
+}
+
+auto readable(std::string const& file) -> bool
+{
+    struct stat info;
+    return stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode) && access(file.c_str(), R_OK) == 0;
+}
+
+// The interpreter named by a script's "#!" line. For "#!/usr/bin/env [options] name" that is
+// name, found as env would find it.
+auto interpreter_of(std::string const& line) -> std::string
+{
+    std::istringstream in{line};
+    std::string interpreter;
+    if (!(in >> interpreter))
+        return {};
+
+    if (interpreter.size() < 4 || interpreter.compare(interpreter.size() - 4, 4, "/env") != 0)
+        return interpreter;
+
+    for (std::string token; in >> token;)
+    {
+        if (token.front() == '-' || token.find('=') != std::string::npos)
+            continue;
+
+        if (token.find('/') != std::string::npos)
+            return token;
+
+        if (auto const path = getenv("PATH"))
+        {
+            for (auto const& dir : split(path, ':'))
+            {
+                if (readable(dir + "/" + token))
+                    return dir + "/" + token;
+            }
+        }
+
+        break;
+    }
+
+    return interpreter;
+}
+
+void add_ld_so_conf(std::string const& file, std::vector<std::string>& dirs, int depth = 0)
+{
+    std::ifstream in{file};
+
+    for (std::string line; std::getline(in, line);)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words{line};
+        std::string word;
+
+        if (!(words >> word))
+            continue;
+
+        if (word == "include" && depth < 4)
+        {
+            for (std::string pattern; words >> pattern;)
+            {
+                glob_t matches;
+                if (glob(pattern.c_str(), 0, nullptr, &matches) == 0)
+                {
+                    for (auto i = 0U; i != matches.gl_pathc; ++i)
+                        add_ld_so_conf(matches.gl_pathv[i], dirs, depth + 1);
+                }
+                globfree(&matches);
+            }
+        }
+        else if (word.front() == '/')
+        {
+            dirs.push_back(word);
+        }
+    }
+}
+
+// Where the dynamic loader looks for libraries (after any RUNPATH and LD_LIBRARY_PATH)
+auto system_library_dirs() -> std::vector<std::string> const&
+{
+    static auto const dirs = []
+        {
+            std::vector<std::string> result;
+            add_ld_so_conf("/etc/ld.so.conf", result);
+            for (auto dir : {"/lib64", "/usr/lib64", "/lib", "/usr/lib"})
+                result.push_back(dir);
+            return result;
+        }();
+
+    return dirs;
+}
+
+auto find_library(std::string const& name, std::string const& runpath, std::string const& origin) -> std::string
+{
+    if (name.find('/') != std::string::npos)
+        return readable(name) ? name : "";
+
+    std::vector<std::string> dirs;
+
+    for (auto dir : split(runpath, ':'))
+    {
+        for (auto const& token : {"$ORIGIN", "${ORIGIN}"})
+        {
+            if (dir.compare(0, strlen(token), token) == 0)
+                dir = origin + dir.substr(strlen(token));
+        }
+        dirs.push_back(dir);
+    }
+
+    if (auto const ld_library_path = getenv("LD_LIBRARY_PATH"))
+    {
+        for (auto const& dir : split(ld_library_path, ':'))
+            dirs.push_back(dir);
+    }
+
+    dirs.insert(dirs.end(), system_library_dirs().begin(), system_library_dirs().end());
+
+    for (auto const& dir : dirs)
+    {
+        if (readable(dir + "/" + name))
+            return dir + "/" + name;
+    }
+
+    return {};
+}
+
+// Adds the DT_NEEDED entries of a (native) ELF file to needed, and returns its DT_RUNPATH (or DT_RPATH)
+auto dynamic_section(char const* data, size_t size, std::vector<std::string>& needed) -> std::string
+{
+    using Ehdr = ElfW(Ehdr);
+    using Shdr = ElfW(Shdr);
+    using Dyn = ElfW(Dyn);
+
+    if (size < sizeof(Ehdr) || memcmp(data, ELFMAG, SELFMAG) != 0 || data[EI_CLASS] != (__ELF_NATIVE_CLASS == 64 ? ELFCLASS64 : ELFCLASS32))
+        return {};
+
+    auto const& header = *reinterpret_cast<Ehdr const*>(data);
+
+    if (header.e_shentsize != sizeof(Shdr) || header.e_shoff > size || (size - header.e_shoff)/sizeof(Shdr) < header.e_shnum)
+        return {};
+
+    auto const* const sections = reinterpret_cast<Shdr const*>(data + header.e_shoff);
+    auto const within = [size](Shdr const& section)
+        { return section.sh_offset <= size && section.sh_size <= size - section.sh_offset; };
+
+    for (auto i = 0; i != header.e_shnum; ++i)
+    {
+        auto const& dynamic = sections[i];
+
+        if (dynamic.sh_type != SHT_DYNAMIC || dynamic.sh_link >= header.e_shnum)
+            continue;
+
+        auto const& strings = sections[dynamic.sh_link];
+        if (!within(dynamic) || !within(strings))
+            return {};
+
+        auto const string = [&](ElfW(Xword) offset) -> std::string
+            {
+                if (offset >= strings.sh_size)
+                    return {};
+                auto const* const start = data + strings.sh_offset + offset;
+                return {start, strnlen(start, strings.sh_size - offset)};
+            };
+
+        std::string runpath;
+        std::string rpath;
+
+        auto const* const entries = reinterpret_cast<Dyn const*>(data + dynamic.sh_offset);
+        for (auto entry = entries; entry != entries + dynamic.sh_size/sizeof(Dyn) && entry->d_tag != DT_NULL; ++entry)
+        {
+            switch (entry->d_tag)
+            {
+            case DT_NEEDED:
+                needed.push_back(string(entry->d_un.d_val));
+                break;
+
+            case DT_RUNPATH:
+                runpath = string(entry->d_un.d_val);
+                break;
+
+            case DT_RPATH:
+                rpath = string(entry->d_un.d_val);
+                break;
+            }
+        }
+
+        return runpath.empty() ? rpath : runpath;
+    }
+
+    return {};
+}
+}
+
+struct egmde::Readahead::Self
+{
+    void run();
+    void read_app(std::string const& program, unsigned generation);
+    auto read_file(std::string const& file, std::vector<std::string>& needed, std::string& runpath, unsigned generation) -> bool;
+    void throttle(off_t bytes, unsigned generation);
+    auto cancelled(unsigned generation) const -> bool { return stopping || generation != this->generation; }
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::atomic<bool> stopping{false};
+    std::atomic<unsigned> generation{0};
+
+    std::string program;
+    std::chrono::steady_clock::time_point changed;
+    unsigned done = 0;
+
+    // For throttling
+    std::chrono::steady_clock::time_point started;
+    off_t bytes_read = 0;
+    off_t app_bytes_read = 0;
+
+    std::thread worker;
+};
+
+void egmde::Readahead::Self::run()
+{
+    // This is speculative work: don't compete with the compositor or anything else
+    sched_param const param{0};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+    std::unique_lock<decltype(mutex)> lock{mutex};
+
+    while (!stopping)
+    {
+        wakeup.wait(lock, [this] { return stopping || generation != done; });
+
+        auto const wanted = generation.load();
+
+        // Wait for the selection to settle
+        if (wakeup.wait_until(lock, changed + dwell, [&] { return cancelled(wanted); }))
+            continue;
+
+        auto const app = program;
+        lock.unlock();
+
+        if (!app.empty())
+            read_app(app, wanted);
+
+        lock.lock();
+        done = wanted;
+    }
+}
+
+void egmde::Readahead::Self::read_app(std::string const& program, unsigned generation)
+{
+    started = std::chrono::steady_clock::now();
+    bytes_read = 0;
+    app_bytes_read = 0;
+
+    // Breadth first through the DT_NEEDED entries
+    std::deque<std::pair<std::string, std::string>> pending{{program, ""}};
+    std::set<std::string> seen{program};
+
+    while (!pending.empty() && seen.size() <= max_files_per_app && !cancelled(generation))
+    {
+        auto const file = pending.front().first;
+        auto const runpath = pending.front().second;
+        pending.pop_front();
+
+        std::vector<std::string> needed;
+        std::string file_runpath;
+
+        if (!read_file(file, needed, file_runpath, generation))
+            continue;
+
+        if (file_runpath.empty())
+            file_runpath = runpath;
+
+        auto const origin = file.substr(0, file.rfind('/'));
+
+        for (auto const& name : needed)
+        {
+            auto const library = find_library(name, file_runpath, origin);
+            if (!library.empty() && seen.insert(library).second)
+                pending.emplace_back(library, file_runpath);
+        }
+    }
+
+    mir::log_debug("Readahead of %s: %zu files, %lld KiB%s", program.c_str(), seen.size(),
+        static_cast<long long>(app_bytes_read >> 10), cancelled(generation) ? " (cancelled)" : "");
+}
+
+auto egmde::Readahead::Self::read_file(
+    std::string const& file, std::vector<std::string>& needed, std::string& runpath, unsigned generation) -> bool
+{
+    int const fd = open(file.c_str(), O_RDONLY|O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        close(fd);
+        return false;
+    }
+
+    auto const size = std::min(info.st_size, max_bytes_per_app - app_bytes_read);
+
+    for (off_t offset = 0; offset < size && !cancelled(generation); offset += chunk_size)
+    {
+        auto const length = std::min(chunk_size, size - offset);
+
+        if (readahead(fd, offset, length) != 0)
+            posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+
+        app_bytes_read += length;
+        throttle(length, generation);
+    }
+
+    // A script: read its interpreter
+    char start[256] = {};
+    if (pread(fd, start, sizeof start - 1, 0) > 2 && start[0] == '#' && start[1] == '!')
+    {
+        auto const interpreter = interpreter_of(std::string{start + 2}.substr(0, strcspn(start + 2, "\n")));
+        if (!interpreter.empty())
+            needed.push_back(interpreter);
+    }
+    else if (auto const mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0); mapping != MAP_FAILED)
+    {
+        runpath = dynamic_section(static_cast<char const*>(mapping), info.st_size, needed);
+        munmap(mapping, info.st_size);
+    }
+
+    close(fd);
+    return true;
+}
+
+void egmde::Readahead::Self::throttle(off_t bytes, unsigned generation)
+{
+    bytes_read += bytes;
+
+    auto const due = started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>{bytes_read/max_bytes_per_second});
+
+    std::unique_lock<decltype(mutex)> lock{mutex};
+    wakeup.wait_until(lock, due, [&] { return cancelled(generation); });
+}
+
+egmde::Readahead::Readahead() :
+    self{std::make_unique<Self>()}
+{
+    self->worker = std::thread{[this] { self->run(); }};
+}
+
+egmde::Readahead::~Readahead()
+{
+    {
+        std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+        self->stopping = true;
+    }
+    self->wakeup.notify_all();
+    self->worker.join();
+}
+
+void egmde::Readahead::anticipate(std::string_view program)
+{
+    {
+        std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+
+        if (program == self->program)
+            return;
+
+        self->program = program;
+        self->changed = std::chrono::steady_clock::now();
+        ++self->generation;
+    }
+    self->wakeup.notify_all();
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGREADAHEAD_H
+#define EGMDE_EGREADAHEAD_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace egmde
+{
+// Speculatively reads the executable of an app that may be launched soon, and the shared
+// libraries it needs, into the page cache. The work is done (throttled) on a background thread.
+class Readahead
+{
+public:
+    Readahead();
+    ~Readahead();
+
+    // The (resolved) path of the program of the app that may be launched next (or "" for none).
+    // Reading starts once this has stayed the same for a short while, and stops as soon as it changes.
+    void anticipate(std::string_view program);
+
+private:
+    struct Self;
+    std::unique_ptr<Self> const self;
+};
+}
+
+#endif //EGMDE_EGREADAHEAD_H
@@ -31,11 +31,20 @@ egmde::ShellCommands::ShellCommands(MirRunner& runner, Launcher& launcher, std::
 {
 }
 
-void egmde::ShellCommands::advise_new_window_for(miral::Application const& /*app*/)
+void egmde::ShellCommands::advise_new_window_for(miral::Application const& app)
 {
-    std::lock_guard<decltype(mutex)> lock{mutex};
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+
+        ++app_windows;
+    }
 
-    ++app_windows;
+    launcher.advise_new_window_for(pid_of(app));
+}
+
+void egmde::ShellCommands::advise_new_surface_for(miral::Application const& app)
+{
+    launcher.advise_new_surface_for(pid_of(app));
 }
 
 void egmde::ShellCommands::advise_delete_window_for(miral::Application const& /*app*/)
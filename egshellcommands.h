@@ -46,6 +46,7 @@ public:
     void init_window_manager(WindowManagerPolicy* wm);
 
     void advise_new_window_for(Application const& app);
+    void advise_new_surface_for(Application const& app);
     void advise_delete_window_for(Application const& app);
 
     auto input_event(MirEvent const* event) -> bool;
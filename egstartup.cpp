@@ -0,0 +1,274 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "egstartup.h"
+
+#include <mir/log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// Apps in one wave, and how long to wait for them to map a window
+size_t const max_wave_size = 4;
+auto const shell_component_timeout = 5s;
+auto const autostart_timeout = 3s;
+
+struct Entry
+{
+    std::string name;
+    std::string command;
+    int priority;
+    pid_t pid = -1;
+    Clock::time_point launched{};
+    bool mapped = false;
+};
+
+auto ms(Clock::duration duration) -> long long
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+auto all_mapped(std::vector<Entry> const& entries) -> bool
+{
+    return std::all_of(begin(entries), end(entries), [](Entry const& e) { return e.mapped || e.pid <= 0; });
+}
+
+auto count_waiting(std::vector<Entry> const& entries) -> long
+{
+    return std::count_if(begin(entries), end(entries), [](Entry const& e) { return !e.mapped && e.pid > 0; });
+}
+}
+
+struct egmde::StartupScheduler::Self
+{
+    explicit Self(std::function<pid_t(std::string const& command)> launch) : launch{std::move(launch)} {}
+
+    void run();
+    void wait_for_windows(std::unique_lock<std::mutex>& lock);
+    auto launch_entries(std::vector<Entry> entries, std::unique_lock<std::mutex>& lock) -> std::vector<Entry>;
+
+    std::function<pid_t(std::string const& command)> const launch;
+    Clock::time_point const start = Clock::now();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    int wave = 0;
+
+    // The apps waited for: shell components, and the last autostart wave
+    std::vector<Entry> shell_components;
+    Clock::time_point shell_deadline = start;
+    std::vector<Entry> outstanding;
+    Clock::time_point wave_deadline = start;
+
+    // Windows seen while a launch was in progress, which may belong to it
+    int launching = 0;
+    std::vector<pid_t> unclaimed_windows;
+
+    std::deque<Entry> pending;
+
+    std::thread worker;
+};
+
+egmde::StartupScheduler::StartupScheduler(std::function<pid_t(std::string const& command)> launch) :
+    self{std::make_unique<Self>(std::move(launch))}
+{
+}
+
+egmde::StartupScheduler::~StartupScheduler()
+{
+    stop();
+}
+
+auto egmde::StartupScheduler::launch_now(std::string const& command) -> pid_t
+{
+    std::unique_lock<decltype(self->mutex)> lock{self->mutex};
+
+    auto launched = self->launch_entries({Entry{command, command, 0}}, lock);
+    auto const pid = launched.front().pid;
+
+    self->shell_components.push_back(std::move(launched.front()));
+    self->shell_deadline = std::max(self->shell_deadline, Clock::now() + shell_component_timeout);
+    return pid;
+}
+
+void egmde::StartupScheduler::schedule(std::string name, std::string command, int priority)
+{
+    std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+    if (self->stopping)
+        return;
+
+    // Keep the queue ordered by priority (and otherwise in the order scheduled)
+    Entry entry{std::move(name), std::move(command), priority};
+    auto const pos = std::find_if(begin(self->pending), end(self->pending),
+        [priority](Entry const& e) { return e.priority < priority; });
+    self->pending.insert(pos, std::move(entry));
+
+    if (!self->worker.joinable())
+        self->worker = std::thread{[self=self.get()] { self->run(); }};
+
+    self->cv.notify_one();
+}
+
+void egmde::StartupScheduler::advise_new_window_for(pid_t pid)
+{
+    std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+
+    if (self->launching)
+        self->unclaimed_windows.push_back(pid);
+
+    for (auto* const entries : {&self->shell_components, &self->outstanding})
+    {
+        for (auto& entry : *entries)
+        {
+            if (entry.pid == pid && !entry.mapped)
+            {
+                entry.mapped = true;
+                auto const now = Clock::now();
+                mir::log_info("startup +%lldms: '%s' mapped a window %lldms after launch",
+                    ms(now - self->start), entry.name.c_str(), ms(now - entry.launched));
+
+                if (all_mapped(*entries))
+                    self->cv.notify_one();
+            }
+        }
+    }
+}
+
+void egmde::StartupScheduler::stop()
+{
+    {
+        std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+        self->stopping = true;
+        self->pending.clear();
+        self->cv.notify_one();
+    }
+
+    if (self->worker.joinable())
+        self->worker.join();
+}
+
+// Launching can block, so the lock is released meanwhile (the entries are only seen by this call)
+auto egmde::StartupScheduler::Self::launch_entries(std::vector<Entry> entries, std::unique_lock<std::mutex>& lock)
+-> std::vector<Entry>
+{
+    ++launching;
+    lock.unlock();
+
+    std::vector<pid_t> pids;
+    for (auto const& entry : entries)
+        pids.push_back(launch(entry.command));
+
+    lock.lock();
+
+    for (size_t i = 0; i != entries.size(); ++i)
+    {
+        auto& entry = entries[i];
+        entry.pid = pids[i];
+        entry.launched = Clock::now();
+        mir::log_info("startup +%lldms: launched '%s' as '%s' (wave %d, priority %d, pid %d)",
+            ms(entry.launched - start), entry.name.c_str(), entry.command.c_str(), wave, entry.priority, entry.pid);
+
+        // The app may have been quicker to map a window than we were to record its pid
+        if (std::find(begin(unclaimed_windows), end(unclaimed_windows), entry.pid) != end(unclaimed_windows))
+        {
+            entry.mapped = true;
+            mir::log_info("startup +%lldms: '%s' mapped a window during launch",
+                ms(entry.launched - start), entry.name.c_str());
+        }
+    }
+
+    if (!--launching)
+        unclaimed_windows.clear();
+
+    return entries;
+}
+
+// Waits until both the shell components and the last wave have mapped windows (or timed out)
+void egmde::StartupScheduler::Self::wait_for_windows(std::unique_lock<std::mutex>& lock)
+{
+    while (!stopping)
+    {
+        auto const now = Clock::now();
+        auto const shell_waiting = now < shell_deadline && !all_mapped(shell_components);
+        auto const wave_waiting = now < wave_deadline && !all_mapped(outstanding);
+
+        if (!shell_waiting && !wave_waiting)
+            break;
+
+        if (shell_waiting && wave_waiting)
+            cv.wait_until(lock, std::min(shell_deadline, wave_deadline));
+        else
+            cv.wait_until(lock, shell_waiting ? shell_deadline : wave_deadline);
+    }
+
+    if (auto const waiting = count_waiting(shell_components))
+    {
+        mir::log_info("startup +%lldms: timed out waiting for %ld shell component(s)",
+            ms(Clock::now() - start), waiting);
+    }
+
+    if (auto const waiting = count_waiting(outstanding))
+    {
+        mir::log_info("startup +%lldms: wave %d timed out waiting for %ld app(s)",
+            ms(Clock::now() - start), wave, waiting);
+    }
+}
+
+void egmde::StartupScheduler::Self::run()
+{
+    std::unique_lock<decltype(mutex)> lock{mutex};
+
+    while (!stopping)
+    {
+        cv.wait(lock, [this] { return stopping || !pending.empty(); });
+        if (stopping)
+            break;
+
+        wait_for_windows(lock);
+        if (stopping || pending.empty())
+            continue;
+
+        shell_components.clear();
+        outstanding.clear();
+
+        // The next wave: the highest priority entries, a few at a time
+        ++wave;
+        std::vector<Entry> next_wave;
+        auto const priority = pending.front().priority;
+        while (!pending.empty() && pending.front().priority == priority && next_wave.size() < max_wave_size)
+        {
+            next_wave.push_back(std::move(pending.front()));
+            pending.pop_front();
+        }
+
+        outstanding = launch_entries(std::move(next_wave), lock);
+        wave_deadline = Clock::now() + autostart_timeout;
+    }
+}
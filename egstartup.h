@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGSTARTUP_H
+#define EGMDE_EGSTARTUP_H
+
+#include <sys/types.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace egmde
+{
+// Spreads out the apps started at login: shell components go first, then autostart entries
+// follow in waves (highest priority first). Each wave waits until the apps in the previous one
+// have mapped a window, or a timeout passes. A timeline of each entry is logged.
+class StartupScheduler
+{
+public:
+    explicit StartupScheduler(std::function<pid_t(std::string const& command)> launch);
+    ~StartupScheduler();
+
+    // Launches a shell component now (autostart entries wait for it)
+    auto launch_now(std::string const& command) -> pid_t;
+
+    // Queues an autostart entry
+    void schedule(std::string name, std::string command, int priority);
+
+    void advise_new_window_for(pid_t pid);
+
+    void stop();
+
+private:
+    struct Self;
+    std::unique_ptr<Self> const self;
+};
+}
+
+#endif //EGMDE_EGSTARTUP_H
@@ -0,0 +1,154 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#include "egusagestore.h"
+#include "eghash.h"
+
+#include <mir/fd.h>
+#include <mir/log.h>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+auto egmde::UsageStore::default_file() -> boost::filesystem::path
+{
+    if (auto const state_home = getenv("XDG_STATE_HOME"))
+    {
+        return boost::filesystem::path{state_home} / "egmde" / "usage";
+    }
+    else if (auto const home = getenv("HOME"))
+    {
+        return boost::filesystem::path{home} / ".local" / "state" / "egmde" / "usage";
+    }
+
+    return {};
+}
+
+egmde::UsageStore::UsageStore(boost::filesystem::path const& file)
+{
+    if (file.empty())
+        return;
+
+    boost::system::error_code error;
+    boost::filesystem::create_directories(file.parent_path(), error);
+
+    mir::Fd const fd{open(file.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, 0600)};
+    struct stat info;
+
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        mir::log_warning("Failed to open %s: %s", file.c_str(), strerror(errno));
+        return;
+    }
+
+    auto const fresh = info.st_size != sizeof(Layout);
+    if (fresh && (ftruncate(fd, 0) != 0 || ftruncate(fd, sizeof(Layout)) != 0))
+    {
+        mir::log_warning("Failed to resize %s: %s", file.c_str(), strerror(errno));
+        return;
+    }
+
+    auto const mapping = mmap(nullptr, sizeof(Layout), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        mir::log_warning("Failed to map %s: %s", file.c_str(), strerror(errno));
+        return;
+    }
+
+    layout = static_cast<Layout*>(mapping);
+
+    if (fresh || memcmp(layout->magic, magic, sizeof magic) != 0)
+    {
+        memset(layout, 0, sizeof(Layout));
+        memcpy(layout->magic, magic, sizeof magic);
+    }
+}
+
+egmde::UsageStore::~UsageStore()
+{
+    if (layout)
+        munmap(layout, sizeof(Layout));
+}
+
+void egmde::UsageStore::record(uint64_t key)
+{
+    if (!layout)
+        return;
+
+    auto const now = seconds_now();
+
+    Slot* match = nullptr;
+    Slot* free = nullptr;
+    Slot* weakest = nullptr;
+
+    for (auto i = 0U; i != probes && !match; ++i)
+    {
+        auto& slot = layout->slots[(key + i) % slot_count];
+
+        if (!valid(slot))
+        {
+            if (!free) free = &slot;
+        }
+        else if (slot.key == key)
+        {
+            match = &slot;
+        }
+        else if (!weakest || score(slot, now) < score(*weakest, now))
+        {
+            weakest = &slot;
+        }
+    }
+
+    Slot updated{key, 1.0 + (match ? score(*match, now) : 0.0), now, 0};
+    updated.checksum = checksum(updated);
+
+    *(match ? match : free ? free : weakest) = updated;
+}
+
+auto egmde::UsageStore::seconds_now() -> int64_t
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+auto egmde::UsageStore::checksum(Slot const& slot) -> uint64_t
+{
+    return egmde::hash({reinterpret_cast<char const*>(&slot), offsetof(Slot, checksum)});
+}
+
+auto egmde::UsageStore::valid(Slot const& slot) -> bool
+{
+    return slot.key && slot.checksum == checksum(slot);
+}
+
+auto egmde::UsageStore::score(Slot const& slot, int64_t now) -> double
+{
+    return slot.score * exp2(-std::max<int64_t>(now - slot.last_used, 0) / half_life);
+}
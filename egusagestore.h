@@ -0,0 +1,95 @@
+/*
+ * Copyright © 2020 Octopull Limited.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authored by: Alan Griffiths <alan@octopull.co.uk>
+ */
+
+#ifndef EGMDE_EGUSAGESTORE_H
+#define EGMDE_EGUSAGESTORE_H
+
+#include <boost/filesystem/path.hpp>
+
+#include <cstdint>
+
+namespace egmde
+{
+// Records app launches in a small, fixed size, memory mapped file. Each app's score is its
+// launches, decayed by age ("frecency"), so recent and frequent use both count.
+// Updates are O(1): an app's slot is found by probing a few slots from its hash (reusing
+// the weakest if none is free). There's no fsync: a slot is written in one go with a checksum,
+// and a slot torn by a crash is treated as free.
+class UsageStore
+{
+public:
+    // $XDG_STATE_HOME/egmde/usage
+    static auto default_file() -> boost::filesystem::path;
+
+    // An empty file records nothing
+    explicit UsageStore(boost::filesystem::path const& file);
+    ~UsageStore();
+
+    UsageStore(UsageStore const&) = delete;
+    UsageStore& operator=(UsageStore const&) = delete;
+
+    void record(uint64_t key);
+
+    // Calls f(key, score) for each app that has been used
+    template<typename F>
+    void for_each(F const& f) const
+    {
+        if (!layout)
+            return;
+
+        auto const now = seconds_now();
+
+        for (auto const& slot : layout->slots)
+        {
+            if (valid(slot))
+                f(slot.key, score(slot, now));
+        }
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t key;
+        double score;       // As of last_used
+        int64_t last_used;  // Seconds since the epoch
+        uint64_t checksum;
+    };
+
+    static auto constexpr slot_count = 512U;
+    static auto constexpr probes = 8U;
+    static auto constexpr half_life = 7*24*60*60.0;
+
+    // Change the version when changing the layout
+    static constexpr char magic[16] = "egmde usage v1\n";
+
+    struct Layout
+    {
+        char magic[sizeof UsageStore::magic];
+        Slot slots[slot_count];
+    };
+
+    Layout* layout = nullptr;
+
+    static auto seconds_now() -> int64_t;
+    static auto checksum(Slot const& slot) -> uint64_t;
+    static auto valid(Slot const& slot) -> bool;
+    static auto score(Slot const& slot, int64_t now) -> double;
+};
+}
+
+#endif //EGMDE_EGUSAGESTORE_H
@@ -21,44 +21,110 @@
 #include "egfullscreenclient.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <ctime>
+#include <map>
+#include <set>
 #include <sstream>
+#include <vector>
 
 namespace
 {
-void render_gradient(int32_t width, int32_t height, unsigned char* row_, uint8_t const* bottom_colour, uint8_t const* top_colour)
+// How often the animated wallpaper checks whether the colours have drifted
+auto const animation_interval = std::chrono::seconds{30};
+// The period over which the animation CPU budget is accounted
+auto const budget_period = std::chrono::minutes{1};
+
+auto row_colour(int32_t j, int32_t height, uint8_t const* bottom_colour, uint8_t const* top_colour) -> uint32_t
 {
-    auto row = row_;
-    for (int j = 0; j < height; j++)
-    {
-        auto* pixel = (uint32_t*)row;
-        uint8_t pattern_[4];
-        for (auto i = 0; i != 3; ++i)
-            pattern_[i] = (j*bottom_colour[i] + (height - j) * top_colour[i]) / height;
-        pattern_[3] = 0xff;
+    uint8_t pattern_[4];
+    for (auto i = 0; i != 3; ++i)
+        pattern_[i] = (j*bottom_colour[i] + (height - j) * top_colour[i]) / height;
+    pattern_[3] = 0xff;
 
-        for (int i = 0; i < width; i++)
-            memcpy(pixel + i, pattern_, sizeof pixel[i]);
+    uint32_t result;
+    memcpy(&result, pattern_, sizeof result);
+    return result;
+}
 
-        row += 4*width;
+void render_rows(int32_t width, unsigned char* content, std::vector<uint32_t> const& colours, int32_t first, int32_t last)
+{
+    for (auto j = first; j != last; ++j)
+    {
+        auto* const pixel = reinterpret_cast<uint32_t*>(content + 4*width*j);
+        std::fill(pixel, pixel + width, colours[j]);
     }
+}
 
+auto render_footer(int32_t width, int32_t height, unsigned char* content) -> int32_t
+{
     static egmde::Printer printer;
 
-    printer.footer(width, height, row_,
+    return printer.footer(width, height, content,
                    {"Ctrl-Alt/Ctrl-Alt-Shift: A = app launcher | T = terminal | [,] = switch app | {,} = switch app window | BkSp = quit",
                          "                         Left,Right = dock | Space = restore,maximise | Up,Down = change workspace"});
 }
+
+// Dim the colours away from midday: brightest at noon, darkest at midnight
+void drift_colour(uint8_t const* colour, uint8_t* drifted)
+{
+    auto const now = time(nullptr);
+    tm local;
+    localtime_r(&now, &local);
+
+    auto const day_fraction = (3600*local.tm_hour + 60*local.tm_min + local.tm_sec) / 86400.0;
+    auto const brightness = 0.65 + 0.35*(1 - cos(2*M_PI*day_fraction))/2;
+
+    for (auto i = 0; i != 3; ++i)
+        drifted[i] = colour[i]*brightness;
+    drifted[3] = colour[3];
+}
+
+auto thread_cpu_time() -> std::chrono::nanoseconds
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec};
+}
 }
 
 struct egmde::Wallpaper::Self : egmde::FullscreenClient
 {
-    Self(wl_display* display, uint8_t* bottom_colour, uint8_t* top_colour);
+    Self(wl_display* display, uint8_t* bottom_colour, uint8_t* top_colour, bool animated, std::chrono::milliseconds budget);
 
     void draw_screen(SurfaceInfo& info) const override;
 
     uint8_t* const bottom_colour;
     uint8_t* const top_colour;
+
+private:
+    // What is currently shown on an output
+    struct Animation
+    {
+        std::vector<uint32_t> row_colours;
+        int32_t footer_top = 0;
+        wl_buffer* buffer = nullptr;
+        wl_callback* frame = nullptr;
+        bool released = false;
+    };
+
+    auto current_row_colours(int32_t height) const -> std::vector<uint32_t>;
+    auto update(SurfaceInfo& info, Animation& animation) const -> bool;
+    void request_frame(wl_surface* surface, Animation& animation) const;
+    void schedule_tick() const;
+    void tick() const;
+    void frame_done(wl_callback* frame) const;
+    void buffer_released(wl_buffer* buffer) const;
+
+    bool const animated;
+    std::chrono::milliseconds const budget;
+
+    // Only accessed on the client thread
+    std::map<Output const*, Animation> mutable animations;
+    bool mutable tick_scheduled = false;
+    std::chrono::steady_clock::time_point mutable budget_period_start;
+    std::chrono::nanoseconds mutable budget_used{0};
 };
 
 void egmde::Wallpaper::Self::draw_screen(SurfaceInfo& info) const
@@ -102,17 +168,233 @@ void egmde::Wallpaper::Self::draw_screen(SurfaceInfo& info) const
             WL_SHM_FORMAT_ARGB8888);
     }
 
-    render_gradient(width, height, static_cast<unsigned char*>(info.content_area), bottom_colour, top_colour);
+    auto& animation = animations[info.output];
+    auto const content = static_cast<unsigned char*>(info.content_area);
+
+    animation.row_colours = current_row_colours(height);
+    render_rows(width, content, animation.row_colours, 0, height);
+    animation.footer_top = render_footer(width, height, content);
+
+    if (animated)
+    {
+        static wl_buffer_listener const buffer_listener{
+            [](void* self, wl_buffer* buffer) { static_cast<Self const*>(self)->buffer_released(buffer); }};
+
+        wl_buffer_add_listener(info.buffer, &buffer_listener, const_cast<Self*>(this));
+        animation.buffer = info.buffer;
+        animation.released = false;
+        request_frame(info.surface, animation);
+    }
 
     wl_surface_attach(info.surface, info.buffer, 0, 0);
     wl_surface_set_buffer_scale(info.surface, info.output->scale_factor);
     wl_surface_commit(info.surface);
 }
 
-egmde::Wallpaper::Self::Self(wl_display* display, uint8_t* bottom_colour, uint8_t* top_colour) :
+auto egmde::Wallpaper::Self::current_row_colours(int32_t height) const -> std::vector<uint32_t>
+{
+    uint8_t bottom[4];
+    uint8_t top[4];
+
+    if (animated)
+    {
+        drift_colour(bottom_colour, bottom);
+        drift_colour(top_colour, top);
+    }
+    else
+    {
+        memcpy(bottom, bottom_colour, sizeof bottom);
+        memcpy(top, top_colour, sizeof top);
+    }
+
+    std::vector<uint32_t> result(height);
+
+    for (int32_t j = 0; j != height; ++j)
+        result[j] = row_colour(j, height, bottom, top);
+
+    return result;
+}
+
+// Redraw the rows whose colour has drifted, returns true if a frame was committed
+auto egmde::Wallpaper::Self::update(SurfaceInfo& info, Animation& animation) const -> bool
+{
+    bool const rotated = info.output->transform & WL_OUTPUT_TRANSFORM_90;
+    auto const width = rotated ? info.output->height : info.output->width;
+    auto const height = rotated ? info.output->width : info.output->height;
+
+    // The compositor may still be reading the buffer
+    if (!animation.released || animation.buffer != info.buffer || animation.row_colours.size() != size_t(height))
+        return false;
+
+    auto const colours = current_row_colours(height);
+    auto const footer_top = begin(colours) + animation.footer_top;
+
+    // The footer is blended with the rows beneath, if any of those change redraw them all
+    bool const redraw_footer =
+        !std::equal(footer_top, end(colours), begin(animation.row_colours) + animation.footer_top);
+
+    if (redraw_footer)
+    {
+        // 0 is never a row colour (they are opaque)
+        std::fill(begin(animation.row_colours) + animation.footer_top, end(animation.row_colours), 0);
+    }
+
+    auto const content = static_cast<unsigned char*>(info.content_area);
+    auto const scale = info.output->scale_factor;
+    bool damaged = false;
+
+    for (int32_t j = 0; j != height;)
+    {
+        if (colours[j] == animation.row_colours[j])
+        {
+            ++j;
+            continue;
+        }
+
+        auto const first = j;
+        while (j != height && colours[j] != animation.row_colours[j])
+            ++j;
+
+        render_rows(width, content, colours, first, j);
+        wl_surface_damage(info.surface, 0, first/scale, (width + scale - 1)/scale, (j + scale - 1)/scale - first/scale);
+        damaged = true;
+    }
+
+    if (!damaged)
+        return false;
+
+    if (redraw_footer)
+        render_footer(width, height, content);
+
+    animation.row_colours = colours;
+    animation.released = false;
+    request_frame(info.surface, animation);
+
+    wl_surface_attach(info.surface, info.buffer, 0, 0);
+    wl_surface_commit(info.surface);
+    return true;
+}
+
+// The frame callback paces the animation: it isn't sent while the output is off or the wallpaper hidden
+void egmde::Wallpaper::Self::request_frame(wl_surface* surface, Animation& animation) const
+{
+    static wl_callback_listener const frame_listener{
+        [](void* self, wl_callback* frame, uint32_t) { static_cast<Self const*>(self)->frame_done(frame); }};
+
+    if (animation.frame)
+        wl_callback_destroy(animation.frame);
+
+    animation.frame = wl_surface_frame(surface);
+    wl_callback_add_listener(animation.frame, &frame_listener, const_cast<Self*>(this));
+}
+
+void egmde::Wallpaper::Self::frame_done(wl_callback* frame) const
+{
+    for (auto& a : animations)
+    {
+        if (a.second.frame == frame)
+            a.second.frame = nullptr;
+    }
+
+    wl_callback_destroy(frame);
+    schedule_tick();
+}
+
+void egmde::Wallpaper::Self::buffer_released(wl_buffer* buffer) const
+{
+    for (auto& a : animations)
+    {
+        if (a.second.buffer == buffer)
+            a.second.released = true;
+    }
+}
+
+void egmde::Wallpaper::Self::schedule_tick() const
+{
+    if (tick_scheduled)
+        return;
+
+    tick_scheduled = true;
+
+    auto delay = std::chrono::steady_clock::duration{animation_interval};
+
+    if (budget_used >= budget)
+    {
+        // Wait for the budget to be replenished
+        delay = std::max(delay, budget_period_start + budget_period - std::chrono::steady_clock::now());
+    }
+
+    call_after(delay, [this] { tick(); });
+}
+
+void egmde::Wallpaper::Self::tick() const
+{
+    tick_scheduled = false;
+
+    auto const now = std::chrono::steady_clock::now();
+    if (now - budget_period_start >= budget_period)
+    {
+        budget_period_start = now;
+        budget_used = std::chrono::nanoseconds{0};
+    }
+
+    if (budget_used >= budget)
+    {
+        schedule_tick();
+        return;
+    }
+
+    auto const start = thread_cpu_time();
+    std::set<Output const*> current;
+    bool idle_output = false;
+
+    for_each_surface([&](SurfaceInfo& info)
+        {
+            current.insert(info.output);
+
+            auto const a = animations.find(info.output);
+            if (a == end(animations) || !info.surface || !info.buffer)
+                return;
+
+            // Waiting for the last update to be presented
+            if (a->second.frame)
+                return;
+
+            if (!update(info, a->second))
+                idle_output = true;
+        });
+
+    budget_used += thread_cpu_time() - start;
+
+    for (auto a = begin(animations); a != end(animations);)
+    {
+        if (current.find(a->first) == end(current))
+        {
+            if (a->second.frame)
+                wl_callback_destroy(a->second.frame);
+
+            a = animations.erase(a);
+        }
+        else
+        {
+            ++a;
+        }
+    }
+
+    // Outputs that committed a frame reschedule when it is presented. If none did (e.g. all
+    // outputs are off) there's nothing to do until that changes.
+    if (idle_output)
+        schedule_tick();
+}
+
+egmde::Wallpaper::Self::Self(
+    wl_display* display, uint8_t* bottom_colour, uint8_t* top_colour, bool animated, std::chrono::milliseconds budget) :
     FullscreenClient(display),
     bottom_colour{bottom_colour},
-    top_colour{top_colour}
+    top_colour{top_colour},
+    animated{animated},
+    budget{budget},
+    budget_period_start{std::chrono::steady_clock::now()}
 {
     wl_display_roundtrip(display);
     wl_display_roundtrip(display);
@@ -155,9 +437,19 @@ void egmde::Wallpaper::top(std::string const& option)
     }
 }
 
+void egmde::Wallpaper::animate(bool option)
+{
+    animated = option;
+}
+
+void egmde::Wallpaper::cpu_budget(int option)
+{
+    animation_budget = std::chrono::milliseconds{std::max(option, 1)};
+}
+
 void egmde::Wallpaper::operator()(wl_display* display)
 {
-    auto client = std::make_shared<Self>(display, bottom_colour, top_colour);
+    auto client = std::make_shared<Self>(display, bottom_colour, top_colour, animated, animation_budget);
     {
         std::lock_guard<decltype(mutex)> lock{mutex};
         self = client;
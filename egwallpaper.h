@@ -22,6 +22,7 @@
 #include <miral/application.h>
 #include <miral/window.h>
 
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -43,6 +44,11 @@ public:
     void bottom(std::string const& option);
     void top(std::string const& option);
 
+    // Used in initialization to enable a slow time-of-day colour drift
+    void animate(bool option);
+    // Used in initialization to limit the CPU time (ms per minute) used to animate
+    void cpu_budget(int option);
+
 private:
     std::mutex mutable mutex;
     std::weak_ptr<mir::scene::Session> weak_session;
@@ -50,6 +56,9 @@ private:
     uint8_t bottom_colour[4] = { 0x0a, 0x24, 0x77, 0xFF };
     uint8_t top_colour[4] = { 0x00, 0x00, 0x00, 0xFF };
 
+    bool animated = false;
+    std::chrono::milliseconds animation_budget{100};
+
     struct Self;
     std::weak_ptr<Self> self;
 };
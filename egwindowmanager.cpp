@@ -27,6 +27,8 @@
 
 #include <linux/input.h>
 
+#include <algorithm>
+
 using namespace mir::geometry;
 using namespace miral;
 
@@ -103,6 +105,9 @@ void egmde::WindowManagerPolicy::advise_new_window(const miral::WindowInfo &wind
 {
     WindowManagementPolicy::advise_new_window(window_info);
 
+    // Includes shell components (e.g. panels) which don't live in the application layer
+    commands->advise_new_surface_for(window_info.window().application());
+
     if (is_application(window_info.depth_layer()))
     {
         commands->advise_new_window_for(window_info.window().application());
@@ -335,53 +340,65 @@ void egmde::WindowManagerPolicy::change_active_workspace(
     auto const old_active_window_shell = old_active_window &&
         !is_application(tools.info_for(old_active_window).depth_layer());
 
-    if (!old_active_window || old_active_window_shell)
-    {
-        // If there's no active window, the first shown grabs focus: get the right one
-        if (auto const ww = workspace_to_active[new_active])
-        {
-            tools.for_each_workspace_containing(ww, [&](std::shared_ptr<Workspace> const& ws)
-            {
-                if (ws == new_active)
-                {
-                    apply_workspace_visible_to(ww);
-                }
-            });
-
-            // If focus was on a shell window, put it on an app
-            if (old_active_window_shell)
-                tools.select_active_window(ww);
-        }
-    }
-
     tools.remove_tree_from_workspace(window, old_active);
     tools.add_tree_to_workspace(window, new_active);
 
+    // Work out the whole switch before changing anything: each change can move focus and update
+    // the scene, so windows already in the right state are left alone and focus is set just once
+    std::vector<Window> in_new_active;
+    std::vector<Window> to_show;
     tools.for_each_window_in_workspace(new_active, [&](Window const& ww)
     {
-        if (is_application(tools.info_for(ww).depth_layer()))
+        auto const& info = tools.info_for(ww);
+        if (is_application(info.depth_layer()))
         {
-            apply_workspace_visible_to(ww);
+            in_new_active.push_back(ww);
+            if (workspace_info_for(info).in_hidden_workspace)
+                to_show.push_back(ww);
         }
     });
 
+    auto const shown = [&](Window const& ww)
+        { return std::find(begin(in_new_active), end(in_new_active), ww) != end(in_new_active); };
+
     bool hide_old_active = false;
+    std::vector<Window> to_hide;
     tools.for_each_window_in_workspace(old_active, [&](Window const& ww)
     {
-        if (is_application(tools.info_for(ww).depth_layer()))
+        auto const& info = tools.info_for(ww);
+        if (is_application(info.depth_layer()) && !shown(ww) && !workspace_info_for(info).in_hidden_workspace)
         {
+            // If we hide the active window focus will shift: do that last
             if (ww == old_active_window)
-            {
-                // If we hide the active window focus will shift: do that last
                 hide_old_active = true;
-                return;
-            }
-
-            apply_workspace_hidden_to(ww);
-            return;
+            else
+                to_hide.push_back(ww);
         }
     });
 
+    // Focus goes to the window that was active when we last left the workspace (unless the
+    // active window stays visible)
+    Window focus;
+    if (!old_active_window || old_active_window_shell || hide_old_active)
+    {
+        if (auto const ww = workspace_to_active[new_active]; ww && shown(ww))
+            focus = ww;
+    }
+
+    // If there's no active window, the first shown grabs focus: make that the right one
+    if (auto const i = std::find(begin(to_show), end(to_show), focus); i != end(to_show))
+        std::rotate(begin(to_show), i, i + 1);
+
+    // Show, then focus (so hiding the old active window doesn't move focus again), then hide
+    for (auto const& ww : to_show)
+        apply_workspace_visible_to(ww);
+
+    if (focus)
+        tools.select_active_window(focus);
+
+    for (auto const& ww : to_hide)
+        apply_workspace_hidden_to(ww);
+
     if (hide_old_active)
     {
         apply_workspace_hidden_to(old_active_window);
@@ -17,166 +17,257 @@
  */
 
 #include "printer.h"
+#include "egblend.h"
 
-#include <unistd.h>
+#include <algorithm>
 #include <iostream>
 
 namespace
 {
-auto default_font() -> char const*
+char32_t const replacement_character = 0xfffd;
+
+// Decodes the UTF-8 sequence at text[pos], advancing pos past it. Malformed sequences decode as
+// U+FFFD (and the next byte is treated as the start of another sequence).
+auto decode(std::string_view text, size_t& pos) -> char32_t
 {
-    static std::string result;
+    auto const lead = static_cast<unsigned char>(text[pos++]);
+    if (lead < 0x80)
+        return lead;
 
-    char const* const debian_path = "/usr/share/fonts/truetype/freefont/";
-    char const* const fedora_path = "/usr/share/fonts/gnu-free/";
-    char const* const fedora_path2= "/usr/share/fonts/liberation-sans/";
-    char const* const arch_path   = "/usr/share/fonts/TTF/";
-    char const* const snap_path   = "/snap/egmde/current/usr/share/fonts/truetype/freefont/";
+    int trailing;
+    char32_t result;
+    char32_t minimum;
 
-    char const* const default_files[] = { "FreeSansBold.ttf", "LiberationSans-Bold.ttf" };
+    if ((lead & 0xe0) == 0xc0)      { trailing = 1; result = lead & 0x1f; minimum = 0x80; }
+    else if ((lead & 0xf0) == 0xe0) { trailing = 2; result = lead & 0x0f; minimum = 0x800; }
+    else if ((lead & 0xf8) == 0xf0) { trailing = 3; result = lead & 0x07; minimum = 0x10000; }
+    else return replacement_character;
 
-    for (auto const default_file : default_files)
+    for (; trailing; --trailing, ++pos)
     {
-        for (auto const path : { debian_path, fedora_path, fedora_path2, arch_path, snap_path })
-        {
-            auto const full_path = std::string{path} + default_file;
-            if (access(full_path.c_str(), R_OK) == 0)
-            {
-                result = full_path;
-                return result.c_str();
-            }
-        }
+        if (pos == text.size() || (static_cast<unsigned char>(text[pos]) & 0xc0) != 0x80)
+            return replacement_character;
+
+        result = (result << 6) | (text[pos] & 0x3f);
     }
 
-    return result.c_str();
-}
+    // Overlong encodings, surrogates and values beyond Unicode
+    if (result < minimum || result > 0x10ffff || (0xd800 <= result && result <= 0xdfff))
+        return replacement_character;
+
+    return result;
 }
 
-egmde::Printer::Printer()
+// The codepoints of UTF-8 text, decoded as they are iterated
+class codepoints
 {
-    static char const* font_file = getenv("EGMDE_FONT");
+public:
+    explicit codepoints(std::string_view text) : text{text} {}
 
-    if (!font_file) font_file = default_font();
+    class iterator
+    {
+    public:
+        iterator(std::string_view text, size_t pos) : text{text}, pos{pos}, next{pos} {}
 
-    if (FT_Init_FreeType(&lib))
-        return;
+        auto operator*() -> char32_t { next = pos; return decode(text, next); }
+        auto operator++() -> iterator& { if (next == pos) decode(text, next); pos = next; return *this; }
+        auto operator!=(iterator const& that) const -> bool { return pos != that.pos; }
 
-    if (FT_New_Face(lib, font_file, 0, &face))
-    {
-        FT_Done_FreeType(lib);
-        throw std::runtime_error{std::string{"WARNING: failed to load font: \""} +  font_file + "\"\n"
-            "(Hint: try setting EGMDE_FONT=<path to a font that exists>"};
-    }
+    private:
+        std::string_view text;
+        size_t pos;
+        size_t next;
+    };
+
+    auto begin() const -> iterator { return {text, 0}; }
+    auto end() const -> iterator { return {text, text.size()}; }
+
+private:
+    std::string_view const text;
+};
+
+auto length(std::string_view text) -> size_t
+{
+    return std::count_if(text.begin(), text.end(), [](char c) { return (c & 0xc0) != 0x80; });
+}
 }
 
-egmde::Printer::~Printer()
+egmde::Printer::Printer() :
+    fonts{FontService::instance()}
 {
-    FT_Done_Face(face);
-    FT_Done_FreeType(lib);
+    fonts.wait_for_font();
 }
 
-void egmde::Printer::print(int32_t width, int32_t height, char unsigned* region_address, std::initializer_list<std::string> const& lines)
+egmde::Printer::~Printer() = default;
+
+auto egmde::Printer::strip(std::string_view text, unsigned pixel_size) -> Strip const&
 {
-    std::string::size_type title_chars = 0;
+    if (auto const i = strip_index.find(StripKeyView{text, pixel_size}); i != strip_index.end())
+    {
+        strips.splice(strips.begin(), strips, i->second);
+        return i->second->second;
+    }
 
-    for (auto const& title : lines)
-        title_chars = std::max(title.size(), title_chars);
+    StripKey key{std::string{text}, pixel_size};
+    Strip result;
 
-    auto const stride = 4*width;
-    auto const fwidth = width / title_chars;
-    auto const title_count = lines.size();
+    std::vector<std::shared_ptr<FontService::Glyph const>> glyphs;
+    glyphs.reserve(length(text));
 
-    FT_Set_Pixel_Sizes(face, fwidth, 0);
+    // Measure: where the glyphs will be drawn relative to the start of the baseline
+    int pen_x = 0;
+    int right = 0;
+    int bottom = 0;
 
-    int title_row = 0;
+    for (auto const ch : codepoints{text})
+    {
+        glyphs.push_back(fonts.glyph(ch, pixel_size));
+        auto const& cached = *glyphs.back();
 
-    for (auto title_ : lines)
-    try
+        result.left = std::min(result.left, pen_x + cached.left);
+        result.top = std::max(result.top, cached.top);
+        right = std::max(right, pen_x + cached.left + static_cast<int>(cached.width));
+        bottom = std::max(bottom, static_cast<int>(cached.rows) - cached.top);
+        result.glyph_height = std::max(result.glyph_height, cached.rows);
+
+        pen_x += cached.advance;
+    }
+
+    result.advance = pen_x;
+    result.width = right - result.left;
+    result.height = result.top + bottom;
+    result.alpha.resize(result.width*result.height);
+
+    // Render
+    pen_x = 0;
+
+    for (auto const& glyph : glyphs)
     {
-        auto const title = converter.from_bytes(title_.c_str());
+        auto const& cached = *glyph;
 
-        int title_width = 0;
-        unsigned int title_height = 0;
+        auto const* src = cached.alpha.data();
+        auto* dest = result.alpha.data() +
+            (result.top - cached.top)*result.width + pen_x + cached.left - result.left;
 
-        for (auto const& ch : title)
+        for (auto row = 0u; row != cached.rows; ++row)
         {
-            FT_Load_Glyph(face, FT_Get_Char_Index(face, ch), FT_LOAD_DEFAULT);
-            auto const glyph = face->glyph;
-            FT_Render_Glyph(glyph, FT_RENDER_MODE_NORMAL);
+            for (auto col = 0u; col != cached.width; ++col)
+                dest[col] |= src[col];
 
-            title_width += glyph->advance.x >> 6;
-            title_height = std::max(title_height, glyph->bitmap.rows);
+            src += cached.width;
+            dest += result.width;
         }
 
-        int base_x = (width - title_width)/2;
-        int base_y = ((++title_row)*height)/(title_count+1) + title_height/2;
+        pen_x += cached.advance;
+    }
 
-        for (auto const& ch : title)
-        {
-            FT_Load_Glyph(face, FT_Get_Char_Index(face, ch), FT_LOAD_DEFAULT);
-            auto const glyph = face->glyph;
-            FT_Render_Glyph(glyph, FT_RENDER_MODE_NORMAL);
+    strips.emplace_front(key, std::move(result));
+    strip_index[std::move(key)] = strips.begin();
 
-            auto const& bitmap = glyph->bitmap;
-            auto const x = base_x + glyph->bitmap_left;
+    if (strips.size() > strip_cache_size)
+    {
+        strip_index.erase(strips.back().first);
+        strips.pop_back();
+    }
 
-            if (static_cast<int>(x + bitmap.width) <= width)
-            {
-                unsigned char* src = bitmap.buffer;
+    return strips.front().second;
+}
 
-                auto const y = base_y - glyph->bitmap_top;
-                auto* dest = region_address + y*stride + 4*x;
+void egmde::Printer::print(int32_t width, int32_t height, char unsigned* region_address,
+    std::initializer_list<std::string_view> const& lines, size_t min_chars)
+{
+    size_t title_chars = std::max<size_t>(min_chars, 1);
 
-                for (auto row = 0u; row != bitmap.rows; ++row)
-                {
-                    for (auto col = 0u; col != 4*bitmap.width; ++col)
-                        dest[col] |= (title_row ==2) ? src[col/4] : src[col/4]/2;
+    for (auto const& title : lines)
+        title_chars = std::max(length(title), title_chars);
 
-                    src += bitmap.pitch;
-                    dest += stride;
-                }
-            }
+    auto const stride = 4*width;
+    auto const fwidth = width / title_chars;
+    auto const title_count = lines.size();
+
+    int title_row = 0;
+
+    for (auto const& title : lines)
+    try
+    {
+        // Titles are rasterised once (for each size) and then composited
+        auto const& cached = strip(title, fwidth);
+
+        int base_x = (width - cached.advance)/2;
+        int base_y = ((++title_row)*height)/(title_count+1) + cached.glyph_height/2;
+
+        auto const x = base_x + cached.left;
+        auto const y = base_y - cached.top;
+
+        auto const first_col = std::max(0, -x);
+        auto const last_col = std::min(cached.width, width - x);
+        auto const first_row = std::max(0, -y);
+        auto const last_row = std::min(cached.height, height - y);
+
+        for (auto row = first_row; row < last_row; ++row)
+        {
+            auto const* src = cached.alpha.data() + row*cached.width;
+            auto* dest = region_address + (y + row)*stride + 4*x;
 
-            base_x += glyph->advance.x >> 6;
-            base_y += glyph->advance.y >> 6;
+            // The current title (the middle one) is brighter
+            blend_or(dest + 4*first_col, src + first_col, last_col - first_col, title_row == 2 ? 0 : 1);
         }
     }
     catch (std::exception const& e)
     {
         puts(e.what());
-        puts(title_.c_str());
-        for (auto c : title_)
-            printf("%2.2x", c & 0xff);
-        printf("\n");
     }
 }
 
-void egmde::Printer::footer(int32_t width, int32_t height, char unsigned* region_address, std::initializer_list<char const*> const& lines)
+void egmde::Printer::label(int32_t width, int32_t height, char unsigned* region_address,
+    int32_t x, int32_t y, int32_t box_width, std::string_view text, unsigned pixel_size)
+try
 {
+    auto const& cached = strip(text, pixel_size);
     auto const stride = 4*width;
 
+    auto const left = x + std::max(0, (box_width - cached.advance)/2) + cached.left;
+    auto const top = y - cached.top;
+
+    auto const first_col = std::max({0, -left, x - left});
+    auto const last_col = std::min({cached.width, width - left, x + box_width - left});
+    auto const first_row = std::max(0, -top);
+    auto const last_row = std::min(cached.height, height - top);
+
+    for (auto row = first_row; row < last_row; ++row)
+    {
+        auto const* src = cached.alpha.data() + row*cached.width;
+        auto* dest = region_address + (top + row)*stride + 4*left;
+
+        blend_over(dest + 4*first_col, src + first_col, last_col - first_col, 0xff);
+    }
+}
+catch (std::exception const& e)
+{
+    puts(e.what());
+}
+
+auto egmde::Printer::footer(int32_t width, int32_t height, char unsigned* region_address, std::initializer_list<std::string_view> const& lines)
+-> int32_t
+{
+    auto const stride = 4*width;
+    auto const fwidth = width / 60;
+    int32_t top = height;
+
     int help_width = 0;
     unsigned int help_height = 0;
     unsigned int line_height = 0;
 
-    for (auto const* rawline : lines)
+    for (auto const line : lines)
     {
         int line_width = 0;
 
-        auto const line = converter.from_bytes(rawline);
-
-        auto const fwidth = width / 60;
-
-        FT_Set_Pixel_Sizes(face, fwidth, 0);
-
-        for (auto const& ch : line)
+        for (auto const ch : codepoints{line})
         {
-            FT_Load_Glyph(face, FT_Get_Char_Index(face, ch), FT_LOAD_DEFAULT);
-            auto const glyph = face->glyph;
-            FT_Render_Glyph(glyph, FT_RENDER_MODE_NORMAL);
+            auto const glyph = fonts.glyph(ch, fwidth);
 
-            line_width += glyph->advance.x >> 6;
-            line_height = std::max(line_height, glyph->bitmap.rows + glyph->bitmap.rows/2);
+            line_width += glyph->advance;
+            line_height = std::max(line_height, glyph->rows + glyph->rows/2);
         }
 
         if (help_width < line_width) help_width = line_width;
@@ -185,37 +276,29 @@ void egmde::Printer::footer(int32_t width, int32_t height, char unsigned* region
 
     int base_y = (height - help_height);
 
-    for (auto const* rawline : lines)
+    for (auto const line : lines)
     {
         int base_x = (width - help_width) / 2;
 
-        auto const line = converter.from_bytes(rawline);
-
-        for (auto const& ch : line)
+        for (auto const ch : codepoints{line})
         {
-            FT_Load_Glyph(face, FT_Get_Char_Index(face, ch), FT_LOAD_DEFAULT);
-            auto const glyph = face->glyph;
-            FT_Render_Glyph(glyph, FT_RENDER_MODE_NORMAL);
+            auto const glyph = fonts.glyph(ch, fwidth);
+            auto const& cached = *glyph;
+            auto const x = base_x + cached.left;
 
-            auto const& bitmap = glyph->bitmap;
-            auto const x = base_x + glyph->bitmap_left;
-
-            if (static_cast<int>(x + bitmap.width) <= width)
+            if (static_cast<int>(x + cached.width) <= width)
             {
-                unsigned char* src = bitmap.buffer;
+                auto const* src = cached.alpha.data();
 
-                auto const y = base_y - glyph->bitmap_top;
+                auto const y = base_y - cached.top;
                 auto* dest = region_address + y * stride + 4 * x;
+                top = std::min(top, y);
 
-                for (auto row = 0u; row != bitmap.rows; ++row)
+                for (auto row = 0u; row != cached.rows; ++row)
                 {
-                    for (auto col = 0u; col != 4 * bitmap.width; ++col)
-                    {
-                        unsigned char pixel = (0xaf*src[col / 4]) / 0xff;
-                        dest[col] = (0xff*pixel + (dest[col] * (0xff - pixel)))/0xff;
-                    }
+                    blend_over(dest, src, cached.width, 0xaf);
 
-                    src += bitmap.pitch;
+                    src += cached.width;
                     dest += stride;
 
                     if (dest > region_address + height * stride)
@@ -223,8 +306,10 @@ void egmde::Printer::footer(int32_t width, int32_t height, char unsigned* region
                 }
             }
 
-            base_x += glyph->advance.x >> 6;
+            base_x += cached.advance;
         }
         base_y += line_height;
     }
+
+    return std::max(top, 0);
 }
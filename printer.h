@@ -19,11 +19,13 @@
 #ifndef EGMDE_PRINTER_H
 #define EGMDE_PRINTER_H
 
-#include <ft2build.h>
-#include FT_FREETYPE_H
+#include "egfontservice.h"
 
-#include <codecvt>
-#include <locale>
+#include <list>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace egmde
 {
@@ -34,20 +36,63 @@ struct Printer
     Printer(Printer const&) = delete;
     Printer& operator=(Printer const&) = delete;
 
-    void print(int32_t width, int32_t height, char unsigned* region_address, std::initializer_list<std::string> const& lines);
-    void footer(int32_t width, int32_t height, char unsigned* region_address, std::initializer_list<char const*> const& lines);
+    // Text is UTF-8 (and, once the glyphs and strips needed are cached, drawing it doesn't allocate).
+    // The lines are sized as if at least min_chars long (so that the size needn't change with the text).
+    void print(int32_t width, int32_t height, char unsigned* region_address,
+        std::initializer_list<std::string_view> const& lines, size_t min_chars = 1);
+    // Draws text centred in [x, x+box_width) with its baseline at y (clipped to the box)
+    void label(int32_t width, int32_t height, char unsigned* region_address,
+        int32_t x, int32_t y, int32_t box_width, std::string_view text, unsigned pixel_size);
+    // Returns the topmost row written
+    auto footer(int32_t width, int32_t height, char unsigned* region_address, std::initializer_list<std::string_view> const& lines) -> int32_t;
 
 private:
-    struct Codecvt : std::codecvt_byname<wchar_t, char, std::mbstate_t>
+
+    // A line of text rasterised as alpha, positioned relative to the start of its baseline
+    struct Strip
+    {
+        int left = 0;
+        int top = 0;
+        int width = 0;
+        int height = 0;
+        int advance = 0;
+        unsigned glyph_height = 0;
+        std::vector<unsigned char> alpha;
+    };
+
+    // The most recently used strips (looked up without copying the text)
+    struct StripKey
+    {
+        std::string text;
+        unsigned pixel_size;
+    };
+
+    struct StripKeyView
+    {
+        std::string_view text;
+        unsigned pixel_size;
+    };
+
+    struct StripOrder
     {
-        Codecvt() : std::codecvt_byname<wchar_t, char, std::mbstate_t>("C") {}
-        ~Codecvt() override = default;
+        using is_transparent = void;
+
+        template<typename Lhs, typename Rhs>
+        auto operator()(Lhs const& lhs, Rhs const& rhs) const -> bool
+        {
+            if (lhs.pixel_size != rhs.pixel_size)
+                return lhs.pixel_size < rhs.pixel_size;
+            return std::string_view{lhs.text} < std::string_view{rhs.text};
+        }
     };
 
-    std::wstring_convert<Codecvt> converter;
+    static size_t const strip_cache_size = 256;
+    std::list<std::pair<StripKey, Strip>> strips;
+    std::map<StripKey, std::list<std::pair<StripKey, Strip>>::iterator, StripOrder> strip_index;
+
+    auto strip(std::string_view text, unsigned pixel_size) -> Strip const&;
 
-    FT_Library lib;
-    FT_Face face;
+    FontService& fonts;
 };
 }
 